@@ -86,7 +86,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -226,7 +226,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
@@ -251,7 +251,7 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 
   c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -260,6 +260,78 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
   d->write_cnt++;
   lock_release (&c->lock);
 }
+
+/* Reads the CNT consecutive sectors starting at SEC_NO from
+   disk D with a single READ SECTOR command.  Sector SEC_NO + I is
+   stored in BUFFERS[I], which must have room for DISK_SECTOR_SIZE
+   bytes.  CNT may be at most DISK_MULTIPLE_MAX.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no,
+                    void *buffers[], size_t cnt)
+{
+  struct channel *c;
+  size_t i;
+
+  ASSERT (d != NULL);
+  ASSERT (buffers != NULL);
+  ASSERT (cnt > 0 && cnt <= DISK_MULTIPLE_MAX);
+
+  c = d->channel;
+  lock_acquire (&c->lock);
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+  for (i = 0; i < cnt; i++)
+    {
+      /* The disk interrupts once per sector, when it is ready to
+         hand the sector over. */
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+               sec_no + i);
+      input_sector (c, buffers[i]);
+    }
+  d->read_cnt += cnt;
+  lock_release (&c->lock);
+}
+
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk D
+   with a single WRITE SECTOR command.  BUFFERS[I] must contain the
+   DISK_SECTOR_SIZE bytes for sector SEC_NO + I, so the data need
+   not be contiguous in memory.  CNT may be at most
+   DISK_MULTIPLE_MAX.  Returns after the disk has acknowledged
+   receiving all of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no,
+                     const void *buffers[], size_t cnt)
+{
+  struct channel *c;
+  size_t i;
+
+  ASSERT (d != NULL);
+  ASSERT (buffers != NULL);
+  ASSERT (cnt > 0 && cnt <= DISK_MULTIPLE_MAX);
+
+  c = d->channel;
+  lock_acquire (&c->lock);
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+  for (i = 0; i < cnt; i++)
+    {
+      /* The disk asks for each sector in turn, and interrupts once
+         it has taken it in. */
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+               sec_no + i);
+      output_sector (c, buffers[i]);
+      sema_down (&c->completion_wait);
+    }
+  d->write_cnt += cnt;
+  lock_release (&c->lock);
+}
 
 /* Disk detection and identification. */
 
@@ -426,18 +498,19 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (sec_no + cnt <= d->capacity);
+  ASSERT (sec_no + cnt <= (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= DISK_MULTIPLE_MAX);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);  /* A count of 0 means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
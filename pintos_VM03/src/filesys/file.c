@@ -84,6 +84,18 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads up to CNT pages of FILE, starting at page-aligned
+   offset FILE_OFS, into the page-sized buffers in PAGES.
+   Returns the number of bytes actually read,
+   which may be less than CNT * PGSIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_read_pages (struct file *file, void *pages[], size_t cnt,
+                 off_t file_ofs)
+{
+  return inode_read_pages (file->inode, pages, cnt, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
@@ -113,6 +125,18 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Writes the first SIZE bytes of the page-sized buffers in PAGES
+   into FILE, starting at page-aligned offset FILE_OFS.
+   Returns the number of bytes actually written,
+   which may be less than SIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_write_pages (struct file *file, void *pages[], off_t size,
+                  off_t file_ofs)
+{
+  return inode_write_pages (file->inode, pages, size, file_ofs);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -249,6 +250,57 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Reads up to CNT pages of INODE, starting at OFFSET, into the
+   page-sized buffers in PAGES, with one multi-sector disk command
+   per page.  OFFSET must be sector-aligned.  Returns the number
+   of bytes actually read, which is less than CNT * PGSIZE if end
+   of file is reached; the rest of the buffers is left untouched. */
+off_t
+inode_read_pages (struct inode *inode, void *pages[], size_t cnt,
+                  off_t offset)
+{
+  enum { SECTORS_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE };
+  void *sectors[SECTORS_PER_PAGE];
+  off_t length = inode_length (inode) - offset;
+  size_t sector_cnt, done, i;
+
+  ASSERT (offset % DISK_SECTOR_SIZE == 0);
+
+  if (length <= 0)
+    return 0;
+  if (length > (off_t) (cnt * PGSIZE))
+    length = cnt * PGSIZE;
+
+  /* Whole sectors are contiguous on disk, so they go straight
+     into the caller's pages.  Going a page at a time keeps the
+     sector list small enough for the kernel stack. */
+  sector_cnt = length / DISK_SECTOR_SIZE;
+  for (done = 0; done < sector_cnt; done += i)
+    {
+      for (i = 0; i < SECTORS_PER_PAGE && done + i < sector_cnt; i++)
+        sectors[i] = (uint8_t *) pages[done / SECTORS_PER_PAGE]
+                     + i * DISK_SECTOR_SIZE;
+      disk_read_multiple (filesys_disk,
+                          byte_to_sector (inode, offset) + done, sectors, i);
+    }
+
+  /* A partial final sector goes through a bounce buffer. */
+  if (length % DISK_SECTOR_SIZE != 0)
+    {
+      uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+      if (bounce == NULL)
+        return sector_cnt * DISK_SECTOR_SIZE;
+      disk_read (filesys_disk,
+                 byte_to_sector (inode, offset) + sector_cnt, bounce);
+      memcpy ((uint8_t *) pages[sector_cnt / SECTORS_PER_PAGE]
+              + sector_cnt % SECTORS_PER_PAGE * DISK_SECTOR_SIZE,
+              bounce, length % DISK_SECTOR_SIZE);
+      free (bounce);
+    }
+
+  return length;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -317,6 +369,57 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Writes the first SIZE bytes of the page-sized buffers in PAGES,
+   in order, into INODE, starting at OFFSET, with one multi-sector
+   disk command per page.  OFFSET must be sector-aligned.  Returns
+   the number of bytes actually written, which is less than SIZE
+   if end of file is reached or an error occurs. */
+off_t
+inode_write_pages (struct inode *inode, void *pages[], off_t size,
+                   off_t offset)
+{
+  enum { SECTORS_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE };
+  const void *sectors[SECTORS_PER_PAGE];
+  off_t length = inode_length (inode) - offset;
+  size_t sector_cnt, done, i;
+
+  ASSERT (offset % DISK_SECTOR_SIZE == 0);
+
+  if (inode->deny_write_cnt || length <= 0)
+    return 0;
+  if (length > size)
+    length = size;
+
+  /* Whole sectors go straight from the caller's pages, a page at
+     a time to keep the sector list small. */
+  sector_cnt = length / DISK_SECTOR_SIZE;
+  for (done = 0; done < sector_cnt; done += i)
+    {
+      for (i = 0; i < SECTORS_PER_PAGE && done + i < sector_cnt; i++)
+        sectors[i] = (const uint8_t *) pages[done / SECTORS_PER_PAGE]
+                     + i * DISK_SECTOR_SIZE;
+      disk_write_multiple (filesys_disk,
+                           byte_to_sector (inode, offset) + done, sectors, i);
+    }
+
+  /* A partial final sector is merged with what is on disk. */
+  if (length % DISK_SECTOR_SIZE != 0)
+    {
+      disk_sector_t sector_idx = byte_to_sector (inode, offset) + sector_cnt;
+      uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+      if (bounce == NULL)
+        return sector_cnt * DISK_SECTOR_SIZE;
+      disk_read (filesys_disk, sector_idx, bounce);
+      memcpy (bounce, (uint8_t *) pages[sector_cnt / SECTORS_PER_PAGE]
+                      + sector_cnt % SECTORS_PER_PAGE * DISK_SECTOR_SIZE,
+              length % DISK_SECTOR_SIZE);
+      disk_write (filesys_disk, sector_idx, bounce);
+      free (bounce);
+    }
+
+  return length;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -0,0 +1,284 @@
+#include <malloc.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A simple user memory allocator.
+
+   Small requests are served from size classes of 16, 32, ...,
+   2048 bytes, header included.  Each class keeps a free list of
+   blocks, refilled by carving a page taken from the heap with
+   sbrk().  Freed small blocks go back on their class's list.
+
+   Larger requests take whole pages from the heap as well.  Freed
+   large blocks go on an address-ordered list, merged with their
+   free neighbours, and are reused first fit; free space that
+   reaches the top of the heap is handed back with a negative
+   sbrk().  (A mapping per block would use up the process's
+   mapping ids long before its memory.) */
+
+#define PAGE_SIZE 4096
+
+/* Smallest and largest block sizes, as powers of 2. */
+#define MIN_SHIFT 4
+#define MAX_SHIFT 11
+#define CLASS_CNT (MAX_SHIFT - MIN_SHIFT + 1)
+
+/* Magic number for detecting corruption. */
+#define BLOCK_MAGIC 0x9a548eed
+
+/* Header in front of each block handed out. */
+struct header
+  {
+    size_t size;                /* Block size, header included. */
+    unsigned magic;             /* Detects corruption. */
+  };
+
+/* A free small block. */
+struct free_block
+  {
+    struct free_block *next;
+  };
+
+/* A free large block.  SIZE overlays the header's. */
+struct large_block
+  {
+    size_t size;                /* Multiple of PAGE_SIZE. */
+    struct large_block *next;   /* Next free large block, higher up. */
+  };
+
+static struct free_block *free_lists[CLASS_CNT];
+static struct large_block *large_list;
+
+/* Returns the size class of a block of SIZE bytes, header
+   included, which must be at most 1 << MAX_SHIFT. */
+static int
+size_class (size_t size)
+{
+  int c = 0;
+
+  while (((size_t) 1 << (MIN_SHIFT + c)) < size)
+    c++;
+  return c;
+}
+
+/* Carves a fresh heap page into blocks of class C.  Returns false
+   if the heap cannot grow. */
+static bool
+refill (int c)
+{
+  size_t block_size = (size_t) 1 << (MIN_SHIFT + c);
+  uint8_t *page = sbrk (0);
+  size_t pad = -(uintptr_t) page & (PAGE_SIZE - 1);
+  size_t ofs;
+
+  if (sbrk (pad + PAGE_SIZE) == (void *) -1)
+    return false;
+  page += pad;
+
+  for (ofs = 0; ofs < PAGE_SIZE; ofs += block_size)
+    {
+      struct free_block *b = (struct free_block *) (page + ofs);
+      b->next = free_lists[c];
+      free_lists[c] = b;
+    }
+  return true;
+}
+
+/* Takes a large block of SIZE bytes, a multiple of PAGE_SIZE,
+   from the large free list, or else from the heap.  Returns a
+   null pointer if the heap cannot grow. */
+static struct header *
+large_alloc (size_t size)
+{
+  struct large_block **bp, *b;
+  uint8_t *top;
+  size_t pad;
+
+  for (bp = &large_list; (b = *bp) != NULL; bp = &b->next)
+    if (b->size >= size)
+      {
+        if (b->size > size)
+          {
+            struct large_block *rest = (struct large_block *) ((uint8_t *) b + size);
+
+            rest->size = b->size - size;
+            rest->next = b->next;
+            *bp = rest;
+          }
+        else
+          *bp = b->next;
+        return (struct header *) b;
+      }
+
+  top = sbrk (0);
+  pad = -(uintptr_t) top & (PAGE_SIZE - 1);
+  if (sbrk (pad + size) == (void *) -1)
+    return NULL;
+  return (struct header *) (top + pad);
+}
+
+/* Puts large block H, whose header gives its size, on the large
+   free list, merging it with free neighbours, and shrinks the
+   heap if the result is at its top. */
+static void
+large_free (struct header *h)
+{
+  struct large_block *b = (struct large_block *) h;
+  struct large_block *prev = NULL, *next = large_list;
+  struct large_block **bp;
+
+  while (next != NULL && next < b)
+    {
+      prev = next;
+      next = next->next;
+    }
+
+  b->next = next;
+  if (next != NULL && (uint8_t *) b + b->size == (uint8_t *) next)
+    {
+      b->size += next->size;
+      b->next = next->next;
+    }
+  if (prev != NULL && (uint8_t *) prev + prev->size == (uint8_t *) b)
+    {
+      prev->size += b->size;
+      prev->next = b->next;
+      b = prev;
+    }
+  else if (prev != NULL)
+    prev->next = b;
+  else
+    large_list = b;
+
+  if (b->next == NULL && (uint8_t *) b + b->size == sbrk (0))
+    {
+      for (bp = &large_list; *bp != b; bp = &(*bp)->next)
+        continue;
+      *bp = NULL;
+      sbrk (-(intptr_t) b->size);
+    }
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct header *h;
+  size_t need;
+
+  if (size == 0 || size > SIZE_MAX - PAGE_SIZE)
+    return NULL;
+  need = size + sizeof *h;
+
+  if (need <= (size_t) 1 << MAX_SHIFT)
+    {
+      int c = size_class (need);
+
+      if (free_lists[c] == NULL && !refill (c))
+        return NULL;
+      h = (struct header *) free_lists[c];
+      free_lists[c] = free_lists[c]->next;
+      h->size = (size_t) 1 << (MIN_SHIFT + c);
+    }
+  else
+    {
+      need = (need + PAGE_SIZE - 1) & ~(size_t) (PAGE_SIZE - 1);
+      h = large_alloc (need);
+      if (h == NULL)
+        return NULL;
+      h->size = need;
+    }
+  h->magic = BLOCK_MAGIC;
+  return h + 1;
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the header of block P, checking it. */
+static struct header *
+header_of (void *p)
+{
+  struct header *h = (struct header *) p - 1;
+
+  ASSERT (h->magic == BLOCK_MAGIC);
+  return h;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving
+   it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  if (new_size == 0) 
+    {
+      free (old_block);
+      return NULL;
+    }
+  else 
+    {
+      void *new_block;
+      size_t old_size;
+
+      if (old_block == NULL)
+        return malloc (new_size);
+      old_size = header_of (old_block)->size - sizeof (struct header);
+      if (new_size <= old_size)
+        return old_block;
+
+      new_block = malloc (new_size);
+      if (new_block != NULL)
+        {
+          memcpy (new_block, old_block, old_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  struct header *h;
+
+  if (p == NULL)
+    return;
+
+  h = header_of (p);
+  h->magic = 0;
+  if (h->size <= (size_t) 1 << MAX_SHIFT)
+    {
+      struct free_block *b = (struct free_block *) h;
+      int c = size_class (h->size);
+
+      b->next = free_lists[c];
+      free_lists[c] = b;
+    }
+  else
+    large_free (h);
+}
@@ -155,6 +155,36 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+void
+msync (mapid_t mapid)
+{
+  syscall1 (SYS_MSYNC, mapid);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+void *
+mmap_anon (void *addr, size_t length)
+{
+  return (void *) syscall2 (SYS_MMAP_ANON, addr, length);
+}
+
+void
+munmap_anon (void *addr)
+{
+  syscall1 (SYS_MUNMAP_ANON, addr);
+}
+
+int
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
 bool
 chdir (const char *dir)
 {
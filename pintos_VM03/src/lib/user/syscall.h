@@ -2,6 +2,8 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,6 +14,13 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Access advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Expect random access. */
+#define MADV_SEQUENTIAL 2       /* Expect sequential access. */
+#define MADV_WILLNEED 3         /* Will be accessed soon. */
+#define MADV_DONTNEED 4         /* Will not be accessed soon. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -37,6 +46,11 @@ void close (int fd);
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+void msync (mapid_t);
+void *sbrk (intptr_t increment);
+void *mmap_anon (void *addr, size_t length);
+void munmap_anon (void *addr);
+int madvise (void *addr, size_t length, int advice);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
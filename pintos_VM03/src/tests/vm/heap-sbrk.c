@@ -0,0 +1,42 @@
+/* Grows the heap with sbrk(), checks that the new memory reads
+   as zeros and holds what is written to it, shrinks the heap by
+   half, and then touches memory the shrink gave back.  The
+   process must be terminated with -1 exit code. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 4096)
+
+void
+test_main (void)
+{
+  uint8_t *base;
+  size_t i;
+
+  CHECK ((base = sbrk (0)) != (void *) -1, "sbrk (0)");
+  CHECK (sbrk (SIZE) == base, "grow heap");
+  for (i = 0; i < SIZE; i++)
+    if (base[i] != 0)
+      fail ("byte %zu of new heap is %d", i, base[i]);
+  msg ("new heap is zeroed");
+
+  for (i = 0; i < SIZE; i++)
+    base[i] = i % 251;
+  for (i = 0; i < SIZE; i++)
+    if (base[i] != i % 251)
+      fail ("byte %zu of heap is %d, not %zu", i, base[i], i % 251);
+  msg ("heap holds written data");
+
+  CHECK (sbrk (-(SIZE / 2)) == base + SIZE, "shrink heap");
+  CHECK (sbrk (0) == base + SIZE / 2, "break moved down");
+  for (i = 0; i < SIZE / 2; i++)
+    if (base[i] != i % 251)
+      fail ("byte %zu of heap is %d after shrink", i, base[i]);
+  msg ("rest of heap intact");
+
+  msg ("touch memory past the break");
+  fail ("read %d past the break", base[SIZE - 1]);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(heap-sbrk) begin
+(heap-sbrk) sbrk (0)
+(heap-sbrk) grow heap
+(heap-sbrk) new heap is zeroed
+(heap-sbrk) heap holds written data
+(heap-sbrk) shrink heap
+(heap-sbrk) break moved down
+(heap-sbrk) rest of heap intact
+(heap-sbrk) touch memory past the break
+heap-sbrk: exit(-1)
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Checks that MADV_DONTNEED drops anonymous pages, which then
+   read back as zeros, and writes dirty mmap pages back to their
+   file before dropping them.  Also checks that madvise() rejects
+   bad ranges and unknown advice with -1. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ANON_SIZE (16 * 4096)
+#define ACTUAL ((uint8_t *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t size = strlen (sample);
+  uint8_t *anon;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  /* Anonymous memory. */
+  CHECK ((anon = mmap_anon (NULL, ANON_SIZE)) != NULL, "mmap_anon");
+  memset (anon, 0x5a, ANON_SIZE);
+  CHECK (madvise (anon, ANON_SIZE, MADV_DONTNEED) == 0,
+         "madvise anonymous memory DONTNEED");
+  for (i = 0; i < ANON_SIZE; i++)
+    if (anon[i] != 0)
+      fail ("byte %zu of dropped memory is %d", i, anon[i]);
+  msg ("dropped memory reads as zeros");
+
+  /* A file mapping. */
+  CHECK (create ("sample.txt", size), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, size);
+  CHECK (madvise (ACTUAL, size, MADV_DONTNEED) == 0,
+         "madvise mapping DONTNEED");
+  check_file ("sample.txt", sample, size);
+  CHECK (!memcmp (ACTUAL, sample, size), "mapping reads back written data");
+
+  /* Bad arguments. */
+  CHECK (madvise (anon + 1, 4096, MADV_NORMAL) == -1, "misaligned address");
+  CHECK (madvise (anon, 0, MADV_NORMAL) == -1, "zero length");
+  CHECK (madvise (ACTUAL, 2 * 4096, MADV_NORMAL) == -1,
+         "range past end of mapping");
+  CHECK (madvise (anon, 4096, 99) == -1, "unknown advice");
+
+  munmap (map);
+  close (handle);
+  munmap_anon (anon);
+}
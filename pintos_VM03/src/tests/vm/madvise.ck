@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) mmap_anon
+(madvise) madvise anonymous memory DONTNEED
+(madvise) dropped memory reads as zeros
+(madvise) create "sample.txt"
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise mapping DONTNEED
+(madvise) open "sample.txt" for verification
+(madvise) verified contents of "sample.txt"
+(madvise) close "sample.txt"
+(madvise) mapping reads back written data
+(madvise) misaligned address
+(madvise) zero length
+(madvise) range past end of mapping
+(madvise) unknown advice
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,111 @@
+/* Allocates about 3 MB in blocks of random sizes with malloc(),
+   more than fits in memory, so that the heap is paged out to
+   swap, then shuffles it with free(), malloc() and realloc()
+   and checks every block's contents along the way. */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 768
+#define MAX_SIZE 8192
+
+static uint8_t *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+static unsigned long seed = 1;
+
+/* Returns a pseudo-random size from 1 to MAX_SIZE. */
+static size_t
+random_size (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % MAX_SIZE + 1;
+}
+
+static void
+fill (size_t i, size_t from)
+{
+  memset (blocks[i] + from, i & 0xff, sizes[i] - from);
+}
+
+static void
+verify (size_t i, size_t size)
+{
+  size_t j;
+
+  for (j = 0; j < size; j++)
+    if (blocks[i][j] != (i & 0xff))
+      fail ("byte %zu of block %zu is %d, not %zu",
+            j, i, blocks[i][j], i & 0xff);
+}
+
+static void
+verify_all (void)
+{
+  size_t i;
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    verify (i, sizes[i]);
+}
+
+void
+test_main (void)
+{
+  size_t i, pass;
+
+  msg ("malloc");
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      sizes[i] = random_size ();
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", sizes[i]);
+      fill (i, 0);
+    }
+  msg ("verify");
+  verify_all ();
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      msg ("free, malloc and realloc, pass %zu", pass + 1);
+      for (i = 0; i < BLOCK_CNT; i++)
+        {
+          size_t size = random_size ();
+
+          if (i % 3 == 0)
+            {
+              free (blocks[i]);
+              blocks[i] = malloc (size);
+              if (blocks[i] == NULL)
+                fail ("malloc of %zu bytes failed", size);
+              sizes[i] = size;
+              fill (i, 0);
+            }
+          else if (i % 3 == 1)
+            {
+              uint8_t *p = realloc (blocks[i], size);
+
+              if (p == NULL)
+                fail ("realloc to %zu bytes failed", size);
+              blocks[i] = p;
+              verify (i, size < sizes[i] ? size : sizes[i]);
+              if (size > sizes[i])
+                {
+                  size_t old = sizes[i];
+                  sizes[i] = size;
+                  fill (i, old);
+                }
+              else
+                sizes[i] = size;
+            }
+        }
+      msg ("verify");
+      verify_all ();
+    }
+
+  msg ("free");
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(malloc-stress) begin
+(malloc-stress) malloc
+(malloc-stress) verify
+(malloc-stress) free, malloc and realloc, pass 1
+(malloc-stress) verify
+(malloc-stress) free, malloc and realloc, pass 2
+(malloc-stress) verify
+(malloc-stress) free
+(malloc-stress) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Maps anonymous memory, lets the kernel pick the address and
+   then picks one itself, checks that each mapping reads as zeros
+   and holds what is written to it, and then touches a mapping
+   after unmapping it.  The process must be terminated with -1
+   exit code. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (32 * 4096)
+#define ACTUAL ((uint8_t *) 0x10000000)
+
+static void
+check_mapping (uint8_t *p)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (p[i] != 0)
+      fail ("byte %zu of mapping is %d", i, p[i]);
+  msg ("mapping is zeroed");
+
+  for (i = 0; i < SIZE; i++)
+    p[i] = i % 253;
+  for (i = 0; i < SIZE; i++)
+    if (p[i] != i % 253)
+      fail ("byte %zu of mapping is %d, not %zu", i, p[i], i % 253);
+  msg ("mapping holds written data");
+}
+
+void
+test_main (void)
+{
+  uint8_t *p;
+
+  CHECK ((p = mmap_anon (NULL, SIZE)) != NULL, "mmap_anon anywhere");
+  check_mapping (p);
+  munmap_anon (p);
+
+  CHECK (mmap_anon (ACTUAL, SIZE) == ACTUAL, "mmap_anon at 0x10000000");
+  CHECK (mmap_anon (ACTUAL + SIZE / 2, SIZE) == NULL,
+         "mmap_anon over it must fail");
+  check_mapping (ACTUAL);
+  munmap_anon (ACTUAL);
+
+  msg ("touch unmapped memory");
+  fail ("read %d from unmapped memory", ACTUAL[0]);
+}
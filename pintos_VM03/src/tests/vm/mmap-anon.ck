@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap_anon anywhere
+(mmap-anon) mapping is zeroed
+(mmap-anon) mapping holds written data
+(mmap-anon) mmap_anon at 0x10000000
+(mmap-anon) mmap_anon over it must fail
+(mmap-anon) mapping is zeroed
+(mmap-anon) mapping holds written data
+(mmap-anon) touch unmapped memory
+mmap-anon: exit(-1)
+EOF
+pass;
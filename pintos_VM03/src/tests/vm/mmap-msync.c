@@ -0,0 +1,41 @@
+/* Writes to a file through a mapping and calls msync, then reads
+   the file back through another handle while the mapping is
+   still in place.  Does it twice, to check that a page written
+   again after msync is written back again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t size = strlen (sample);
+  int handle;
+  mapid_t map;
+
+  CHECK (create ("sample.txt", size), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  /* Write file via mmap and sync it. */
+  memcpy (ACTUAL, sample, size);
+  msg ("msync");
+  msync (map);
+  check_file ("sample.txt", sample, size);
+
+  /* Write it again and sync again. */
+  memset (sample, '#', 64);
+  memset (ACTUAL, '#', 64);
+  msg ("msync again");
+  msync (map);
+  check_file ("sample.txt", sample, size);
+
+  CHECK (!memcmp (ACTUAL, sample, size), "mapping still intact");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "sample.txt"
+(mmap-msync) open "sample.txt"
+(mmap-msync) mmap "sample.txt"
+(mmap-msync) msync
+(mmap-msync) open "sample.txt" for verification
+(mmap-msync) verified contents of "sample.txt"
+(mmap-msync) close "sample.txt"
+(mmap-msync) msync again
+(mmap-msync) open "sample.txt" for verification
+(mmap-msync) verified contents of "sample.txt"
+(mmap-msync) close "sample.txt"
+(mmap-msync) mapping still intact
+(mmap-msync) end
+EOF
+pass;
@@ -28,7 +28,9 @@
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "vm/frame.h"
+#include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #else
 #include "tests/threads/tests.h"
 #endif
@@ -94,6 +96,13 @@ console_init ();
   palloc_init ();
   malloc_init ();
   paging_init ();
+#ifdef VM
+  if (page_large && !pagedir_enable_large ())
+    {
+      printf ("CPU lacks 4 MB pages, -largepages ignored\n");
+      page_large = false;
+    }
+#endif
   
 
   /* Segmentation. */
@@ -101,6 +110,7 @@ console_init ();
   tss_init ();
   gdt_init ();
   frame_tabl_init ();
+  page_zero_init ();
   //printf("LINE104\n");
 
 #endif
@@ -126,6 +136,8 @@ console_init ();
   disk_init ();
   filesys_init (format_filesys);
   swap_table_init ();
+  zswap_init ();
+  frame_pageout_start ();
   //printf("Line126\n");
 #endif
 
@@ -266,6 +278,34 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-vmpolicy"))
+        {
+          if (value == NULL || !frame_set_policy (value))
+            PANIC ("unknown page replacement policy `%s'", value);
+        }
+      else if (!strcmp (name, "-swap"))
+        {
+          if (value == NULL || !swap_set_disks (value))
+            PANIC ("bad swap disk list `%s'", value);
+        }
+      else if (!strcmp (name, "-swapra"))
+        {
+          int pages = value != NULL ? atoi (value) : 0;
+          if (pages < 1 || pages > SWAP_READAHEAD_MAX)
+            PANIC ("swap readahead must be 1 to %d pages", SWAP_READAHEAD_MAX);
+          swap_readahead = pages;
+        }
+      else if (!strcmp (name, "-zswap"))
+        {
+          int pages = value != NULL ? atoi (value) : -1;
+          if (pages < 0 || pages > ZSWAP_MAX_PAGES)
+            PANIC ("compressed swap must be 0 to %d pages", ZSWAP_MAX_PAGES);
+          zswap_pages = pages;
+        }
+      else if (!strcmp (name, "-largepages"))
+        page_large = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -381,6 +421,13 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -vmpolicy=POLICY   Page replacement: clock, wsclock or aging.\n"
+          "  -swap=1:D[,1:D]... Swap on disks hd1:D, striped (default: 1:1).\n"
+          "  -swapra=PAGES      Read up to PAGES pages per swap fault.\n"
+          "  -zswap=PAGES       Keep up to PAGES pages of compressed swap.\n"
+          "  -largepages        Back big anonymous regions with 4 MB pages.\n"
 #endif
           );
   power_off ();
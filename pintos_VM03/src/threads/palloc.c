@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -32,6 +34,7 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t free_cnt;                    /* Number of free pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -43,6 +46,7 @@ size_t user_page_limit = SIZE_MAX;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void adjust_free_cnt (struct pool *, int delta);
 
 /* Initializes the page allocator. */
 void
@@ -86,6 +90,8 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  if (page_idx != BITMAP_ERROR)
+    adjust_free_cnt (pool, -(int) page_cnt);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -146,6 +152,41 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  adjust_free_cnt (pool, page_cnt);
+}
+
+/* Obtains 1 << PTBITS contiguous free pages from the user pool,
+   starting at a physical address that is a multiple of PTSPAN,
+   enough to back one 4 MB page.  PAL_ZERO is honored as for
+   palloc_get_multiple().  Returns a null pointer if no such run
+   of pages is free; PAL_ASSERT is not honored, since that is
+   the common case under any load. */
+void *
+palloc_get_large (enum palloc_flags flags)
+{
+  struct pool *pool = &user_pool;
+  size_t page_cnt = 1 << PTBITS;
+  uintptr_t base = vtop (pool->base);
+  size_t page_idx = (ROUND_UP (base, PTSPAN) - base) / PGSIZE;
+  void *pages = NULL;
+
+  ASSERT (flags & PAL_USER);
+
+  lock_acquire (&pool->lock);
+  for (; page_idx + page_cnt <= bitmap_size (pool->used_map);
+       page_idx += page_cnt)
+    if (bitmap_none (pool->used_map, page_idx, page_cnt))
+      {
+        bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+        adjust_free_cnt (pool, -(int) page_cnt);
+        pages = pool->base + PGSIZE * page_idx;
+        break;
+      }
+  lock_release (&pool->lock);
+
+  if (pages != NULL && (flags & PAL_ZERO))
+    memset (pages, 0, PGSIZE * page_cnt);
+  return pages;
 }
 
 /* Frees the page at PAGE. */
@@ -155,6 +196,39 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the kernel virtual address of the first page in the
+   user pool. */
+void *
+palloc_user_base (void) 
+{
+  return user_pool.base;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void) 
+{
+  return user_pool.free_cnt;
+}
+
+/* Adds DELTA to POOL's count of free pages.  Pages are freed
+   without the pool lock, even from the scheduler, so the update
+   is made atomic by turning interrupts off. */
+static void
+adjust_free_cnt (struct pool *pool, int delta) 
+{
+  enum intr_level old_level = intr_disable ();
+  pool->free_cnt += delta;
+  intr_set_level (old_level);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -174,6 +248,7 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = page_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -568,11 +568,20 @@ init_thread (struct thread *t, const char *name, int priority)
   for(i=0;i<NO_FILE_MAX;i++) {
     t ->fd_table[i] = NULL;
   }
+  t -> tlb_batch = 0;
+  t -> tlb_stale = false;
 #endif  
 
 #ifdef VM
   for (i = 0; i < NO_FILE_MAX; i++)
     (t -> mmap_table[i]).start_vaddr = NULL;
+  list_init (&t -> frames);
+  list_init (&t -> shared_pages);
+  list_init (&t -> vmas);
+  t -> vma_hint = NULL;
+  t -> heap_start = t -> brk = NULL;
+  t -> stack_low = NULL;
+  t -> stack_grow = 1;
 #endif
 
 }
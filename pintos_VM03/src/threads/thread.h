@@ -24,7 +24,7 @@ typedef int tid_t;
 #ifdef VM
 struct mmap_entry
 {
-  struct file* mfile;
+  struct file* mfile;           /* NULL for an anonymous mapping. */
   void * start_vaddr;
 };
 #endif
@@ -118,6 +118,8 @@ struct thread
     /* Owned by userprog/process.c. */
     bool user;
     uint32_t *pagedir;                  /* Page directory. */
+    int tlb_batch;                      /* Nesting of TLB flush batches. */
+    bool tlb_stale;                     /* TLB flush deferred by a batch. */
     struct file* fd_table[NO_FILE_MAX] ;
     struct t_status *stat;
     struct list t_children;
@@ -129,6 +131,14 @@ struct thread
 #ifdef VM
     uint32_t *spd;
     struct mmap_entry mmap_table[NO_FILE_MAX]; 
+    struct list frames;                 /* Frames owned (vm/frame.c). */
+    struct list shared_pages;           /* Shared text pages mapped. */
+    struct list vmas;                   /* Mapped regions (vm/page.c). */
+    struct vma *vma_hint;               /* Last VMA found. */
+    uint8_t *heap_start;                /* Start of the sbrk heap. */
+    uint8_t *brk;                       /* End of the sbrk heap. */
+    uint8_t *stack_low;                 /* Lowest stack page mapped. */
+    size_t stack_grow;                  /* Stack pages per growth. */
 #endif
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -183,9 +183,7 @@ page_fault (struct intr_frame *f)
   {
     if (!page_supp_chkmap(t->spd, fault_addr))
       if (is_stack_access(stack_ptr, fault_addr)) {
-          dflag = page_supp_set_addr(t -> spd, fault_addr, 0, PAG_ZERO, 0, true, true);
-          dflag &= page_to_memory(t -> spd, fault_addr);
-          dflag = !dflag;
+          dflag = !page_stack_grow(t, fault_addr, write);
           error_code = -9;
       }
       else { 
@@ -196,9 +194,13 @@ page_fault (struct intr_frame *f)
     /* Either trying to write to a non writable
     or user accessing kernel page */
     else
-      page_to_memory(t->spd, fault_addr);
+      dflag = !page_to_memory(t->spd, fault_addr, write);
   }
 
+  /* First write to a page that still maps the zero page. */
+  else if (write && page_zero_mapped(t -> spd, fault_addr))
+    dflag = !page_zero_copy(t -> spd, fault_addr);
+
   else {
     error_code = -7;
     dflag = true;
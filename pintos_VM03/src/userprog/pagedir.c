@@ -5,9 +5,18 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+
+/* CR4 bit that turns on 4 MB pages, and the CPUID feature bit
+   that says the CPU has them.  See [IA32-v3a] 3.7.3 "Mixing
+   4-KByte and 4-MByte Pages". */
+#define CR4_PSE 0x10
+#define CPUID_PSE 0x8
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static uint32_t *lookup_large (uint32_t *, const void *);
+static void split_or_panic (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -34,7 +43,9 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != base_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+      palloc_free_multiple (ptov (*pde & PTE_ADDR), 1 << PTBITS);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -67,6 +78,7 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
   //test code
+  ASSERT ((*pde & PTE_PS) == 0);
 
   if (*pde == 0) 
     {
@@ -127,9 +139,13 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
-  uint32_t *pte;
+  uint32_t *pte, *pde;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  pde = lookup_large (pd, uaddr);
+  if (pde != NULL)
+    return ptov (*pde & PTE_ADDR) + ((uintptr_t) uaddr & (PTSPAN - 1));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -141,7 +157,8 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
-   UPAGE need not be mapped. */
+   UPAGE need not be mapped.  A 4 MB page holding UPAGE is split
+   first. */
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
@@ -150,11 +167,12 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
+  split_or_panic (pd, upage);
   pte = lookup_page (pd, upage, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -165,24 +183,30 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
-   in PD. */
+   in PD, splitting a 4 MB page that holds VPAGE. */
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte;
+
+  split_or_panic (pd, vpage);
+  pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (dirty)
         *pte |= PTE_D;
-      else 
+      else if ((*pte & PTE_D) != 0)
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -194,28 +218,126 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = lookup_large (pd, vpage);
+
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD, splitting a 4 MB page that holds VPAGE. */
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte;
+
+  split_or_panic (pd, vpage);
+  pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (accessed)
         *pte |= PTE_A;
-      else 
+      else if ((*pte & PTE_A) != 0)
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Turns on 4 MB pages, if the CPU has them.  Returns true if
+   successful. */
+bool
+pagedir_enable_large (void) 
+{
+  uint32_t eax = 1, ebx, ecx, edx, cr4;
+
+  /* See [IA32-v2a] "CPUID--CPU Identification". */
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if ((edx & CPUID_PSE) == 0)
+    return false;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE) : "memory");
+  return true;
+}
+
+/* Maps the PTSPAN bytes of user virtual memory starting at UPAGE
+   in PD to the physical frames starting at kernel virtual
+   address KPAGE with a single 4 MB page.  Both addresses must be
+   multiples of PTSPAN, and KPAGE should come from
+   palloc_get_large().  The range must have no page table yet.
+   Returns true if successful, false if it has one. */
+bool
+pagedir_set_large (uint32_t *pd, void *upage, void *kpage, bool writable) 
+{
+  uint32_t *pde;
+
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT ((vtop (kpage) & (PTSPAN - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != base_page_dir);
+
+  pde = pd + pd_no (upage);
+  if (*pde != 0)
+    return false;
+  *pde = vtop (kpage) | PTE_PS | PTE_U | PTE_P | (writable ? PTE_W : 0);
+  return true;
+}
+
+/* Replaces the 4 MB page that maps VPAGE in PD, if any, by a
+   page table mapping the same frames as 4 kB pages.  The new
+   PTEs inherit the accessed and dirty bits of the large page, as
+   there is no telling which of its parts they belong to.
+   Returns false if the page table cannot be allocated. */
+bool
+pagedir_split_large (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pde = lookup_large (pd, vpage);
+  uint32_t *pt;
+  uint8_t *kpage;
+  size_t i;
+
+  if (pde == NULL)
+    return true;
+
+  pt = palloc_get_page (0);
+  if (pt == NULL)
+    return false;
+  kpage = ptov (*pde & PTE_ADDR);
+  for (i = 0; i < 1 << PTBITS; i++)
+    pt[i] = (pte_create_user (kpage + i * PGSIZE, (*pde & PTE_W) != 0)
+             | (*pde & (PTE_A | PTE_D)));
+  *pde = pde_create (pt);
+
+  /* One INVLPG anywhere in the large page drops all of it. */
+  invalidate_page (pd, vpage);
+  return true;
+}
+
+/* Returns the PDE of the 4 MB page that maps VADDR in PD, or a
+   null pointer if VADDR is not mapped by one. */
+static uint32_t *
+lookup_large (uint32_t *pd, const void *vaddr) 
+{
+  uint32_t *pde;
+
+  ASSERT (pd != NULL);
+
+  pde = pd + pd_no (vaddr);
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Splits the 4 MB page mapping VPAGE in PD, if any, before one
+   of its 4 kB parts is changed on its own. */
+static void
+split_or_panic (uint32_t *pd, const void *vpage) 
+{
+  if (!pagedir_split_large (pd, vpage))
+    PANIC ("out of memory splitting a 4 MB page");
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -247,19 +369,59 @@ active_pd (void)
 
 /* Seom page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry of the page that changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Inside a batch, the running thread's invalidations
+   are put off to the end of the batch.  A bit that was already
+   clear cannot be cached as set, so clearing it again needs no
+   invalidation; the callers above skip that case. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage) 
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      struct thread *t = thread_current ();
+
+      if (t->tlb_batch > 0)
+        t->tlb_stale = true;
+      else
+        {
+          /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+          asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+        }
     } 
 }
+
+/* Starts a batch of page table changes by the running thread:
+   TLB invalidations they need are put off until the matching
+   pagedir_batch_end(), which flushes the TLB once.  Batches nest.
+   Within a batch the running thread must not rely on the changed
+   mappings through user addresses.  A context switch in the
+   middle does no harm, as activating a page directory flushes
+   the TLB anyway. */
+void
+pagedir_batch_begin (void) 
+{
+  thread_current ()->tlb_batch++;
+}
+
+/* Ends a batch started by pagedir_batch_begin(). */
+void
+pagedir_batch_end (void) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->tlb_batch > 0);
+  if (--t->tlb_batch == 0 && t->tlb_stale)
+    {
+      t->tlb_stale = false;
+
+      /* Re-activating the page directory clears the TLB.  See
+         [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)". */
+      pagedir_activate (active_pd ());
+    }
+}
@@ -14,5 +14,10 @@ void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+bool pagedir_enable_large (void);
+bool pagedir_set_large (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_split_large (uint32_t *pd, const void *upage);
+void pagedir_batch_begin (void);
+void pagedir_batch_end (void);
 
 #endif /* userprog/pagedir.h */
@@ -218,6 +218,10 @@ process_exit (void)
       munmap_kernel(j);
   }
 
+  /* Drop shared text pages while the executable is still
+     write-protected. */
+  frame_unshare_all(cur);
+
   /* Close the executable file */
   if (cur -> exec_file != NULL) {
     file_allow_write(cur -> exec_file);
@@ -255,9 +259,11 @@ process_exit (void)
     lock_release (&child_stat->l);
     free (child_stat);
   }
-  /* Need to think about the order of removal */
-   page_supp_destroy(cur -> spd);
+  /* Drop our frames before the supplemental page table: an
+     eviction that picks one of them still needs our spd. */
    frame_free_all(cur);
+   page_supp_destroy(cur -> spd, cur -> pagedir);
+   page_vma_destroy(cur);
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -482,6 +488,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
         }
     }
 
+  /* The heap starts right after the highest segment. */
+  t -> heap_start = t -> brk = page_vma_top (t);
+
   /* Set up stack. */
    
   void *argv_p[128];
@@ -576,51 +585,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
   struct thread *t=thread_current();
-  file_seek (file, ofs);
-  int file_offt = ofs;
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      if(page_read_bytes == 0)
-      {
-        page_supp_set (t->spd, upage, 0, 
-                PAG_ZERO,  file_offt, writable, false);
-      }
-      else
-      {
-        page_supp_set (t->spd, upage, page_zero_bytes, 
-                PAG_FILE,  file_offt, writable, false);
-        file_offt += page_read_bytes;
 
-      }
+  /* The segment becomes one region of the address space; its
+     pages get supp page table entries when first touched. */
+  if (!page_vma_add (t, upage, read_bytes + zero_bytes, ofs, read_bytes,
+                     writable, -1))
+    return false;
 
-      // /* Load this page. */
-      // if (page_read_bytes < PGSIZE)
-      //   {
-      //     palloc_free_page (kpage);
-      //     return false; 
-      //   }
-      // memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-      // /* Add the page to the process's address space. */
-      // if (!install_page (upage, kpage, writable)) 
-      //   {
-      //     palloc_free_page (kpage);
-      //     return false; 
-      //   }
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-    }
-    file_seek(file, file_offt);
-    //printf("AFTER LOADING\n");
+  file_seek (file, ofs + read_bytes);
   return true;
 }
 
@@ -638,7 +610,10 @@ setup_stack (void **esp, char *cmdline, void **argv, int *argc)
     {
       success = page_supp_set (t -> spd, ((uint8_t *) PHYS_BASE) - PGSIZE, 0, PAG_ZERO, 0, true, false);
       if (success)
+      {
         *esp = PHYS_BASE;
+        t -> stack_low = ((uint8_t *) PHYS_BASE) - PGSIZE;
+      }
     }
 
   
@@ -11,6 +11,10 @@
 #include "filesys/filesys.h"
 #include "devices/input.h"
 #include "vm/page.h"
+#include "vm/frame.h"
+
+/* Most dirty mmap pages written back with one write. */
+#define MUNMAP_BATCH 32
 
 //for the list of system call handlers
 typedef void (*call_handler) (void **,struct intr_frame *);
@@ -40,6 +44,12 @@ void sys_exec_handler(void **args, struct intr_frame *f);
 void sys_wait_handler(void **args, struct intr_frame *f);
 void sys_mmap_handler(void **args, struct intr_frame *f);
 void sys_munmap_handler(void **args, struct intr_frame *f);
+void sys_msync_handler(void **args, struct intr_frame *f);
+void sys_sbrk_handler(void **args, struct intr_frame *f);
+void sys_mmap_anon_handler(void **args, struct intr_frame *f);
+void sys_munmap_anon_handler(void **args, struct intr_frame *f);
+void sys_madvise_handler(void **args, struct intr_frame *f);
+static void mmap_write_back (struct thread *t, mapid_t mid);
 
 void get_arguments(void **,void *,int);
 
@@ -66,6 +76,11 @@ syscall_init (void)
   syscall_list[SYS_CLOSE] = &sys_close_handler;
   syscall_list[SYS_MMAP] = &sys_mmap_handler;
   syscall_list[SYS_MUNMAP] = &sys_munmap_handler;
+  syscall_list[SYS_MSYNC] = &sys_msync_handler;
+  syscall_list[SYS_SBRK] = &sys_sbrk_handler;
+  syscall_list[SYS_MMAP_ANON] = &sys_mmap_anon_handler;
+  syscall_list[SYS_MUNMAP_ANON] = &sys_munmap_anon_handler;
+  syscall_list[SYS_MADVISE] = &sys_madvise_handler;
 
   syscall_no_args[SYS_HALT] = 0;
   syscall_no_args[SYS_EXIT] = 1;
@@ -82,6 +97,11 @@ syscall_init (void)
   syscall_no_args[SYS_CLOSE] = 1;
   syscall_no_args[SYS_MMAP] = 2;
   syscall_no_args[SYS_MUNMAP] = 1;
+  syscall_no_args[SYS_MSYNC] = 1;
+  syscall_no_args[SYS_SBRK] = 1;
+  syscall_no_args[SYS_MMAP_ANON] = 2;
+  syscall_no_args[SYS_MUNMAP_ANON] = 1;
+  syscall_no_args[SYS_MADVISE] = 3;
 
 
   lock_init(&filesys_lock);
@@ -193,6 +213,37 @@ check_buf(char* buffer, unsigned length){
   return valid;
 }
 
+/* Reads (if READ) or writes LENGTH bytes between FILE and the
+   user BUFFER, a few pages at a time.  Each chunk is faulted in
+   and pinned before taking filesys_lock, which the fault path
+   needs too; pinning only a chunk keeps a big buffer from pinning
+   all of user memory.  Returns the number of bytes transferred. */
+static unsigned
+file_xfer (struct file *file, char *buffer, unsigned length, bool read)
+{
+  struct thread *t = thread_current ();
+  unsigned done = 0;
+
+  while (done < length)
+    {
+      char *p = buffer + done;
+      unsigned max = frame_pin_limit () * PGSIZE - pg_ofs (p);
+      unsigned chunk = length - done < max ? length - done : max;
+      off_t n;
+
+      frame_pin_range (t, p, chunk, read);
+      lock_acquire (&filesys_lock);
+      n = read ? file_read (file, p, chunk) : file_write (file, p, chunk);
+      lock_release (&filesys_lock);
+      frame_unpin_range (t, p, chunk);
+
+      done += n;
+      if ((unsigned) n < chunk)
+        break;
+    }
+  return done;
+}
+
  // hex_dump(f->esp,f->esp,512,true);
 void sys_write_handler(void **args, struct intr_frame *f)
 {
@@ -215,13 +266,10 @@ void sys_write_handler(void **args, struct intr_frame *f)
 
       else if(fd>=2 && fd < 128)
       {
-      	lock_acquire(&filesys_lock);
         struct file* file = t->fd_table[fd];
         
         if( file != NULL)
-          len_written = file_write (file, buffer, length);
-
-      	lock_release(&filesys_lock);
+          len_written = file_xfer (file, buffer, length, false);
       }
 
     }
@@ -253,13 +301,10 @@ void sys_read_handler(void **args, struct intr_frame *f)
 
       else if(fd>=2 && fd < 128)
       {
-      	lock_acquire(&filesys_lock);
         struct file* file = t->fd_table[fd];
         
         if( file != NULL)
-          len_written = file_read (file, buffer, length);
-
-      	lock_release(&filesys_lock);
+          len_written = file_xfer (file, buffer, length, true);
       }
 
     }
@@ -459,12 +504,23 @@ sys_wait_handler(void **args, struct intr_frame *f) {
     return;
 }
 
+/* Returns the first free mmap id of T, or -1 if there is none. */
+static mapid_t
+mmap_alloc_id (struct thread *t)
+{
+  int j;
+
+  for (j = 2; j < NO_FILE_MAX; j++)
+    if ((t->mmap_table[j]).start_vaddr == NULL)
+      return j;
+  return -1;
+}
+
 void
 sys_mmap_handler(void **args, struct intr_frame *f)
 {
-  int fd = *((int *)args[0]), j;
+  int fd = *((int *)args[0]);
   void* vaddr = *((char**)args[1]);
-  void* i;
   struct thread* t = thread_current();
 
   struct file* file = t -> fd_table[fd];
@@ -480,33 +536,26 @@ sys_mmap_handler(void **args, struct intr_frame *f)
       return;
     }
 
-    for (i = vaddr; i <vaddr + length; i += PGSIZE)
-      if (page_supp_chkmap(t -> spd, i))
-      {
-        f -> eax = -1;
-        return;
-      } 
+    if (page_vma_overlaps (t, vaddr, length))
+    {
+      f -> eax = -1;
+      return;
+    }
 
-    mapid_t mid;
+    mapid_t mid = mmap_alloc_id(t);
 
-    /* Get the first free mmap id */
-    for (j = 2; j < NO_FILE_MAX; j++)
-      if ((t->mmap_table[j]).start_vaddr == NULL)
-        {
-          mid = j;
-          break;
-        }
+    /* Map the whole file as one region; the supp page table
+       entries are made as the pages are touched. */
+    if (mid < 0 || !page_vma_add (t, vaddr, length, 0, length, true, mid))
+    {
+      f -> eax = -1;
+      return;
+    }
 
     /* Set the mmap table entries */
     (t->mmap_table[mid]).mfile = file_reopen(file);
     (t->mmap_table[mid]).start_vaddr = vaddr;
 
-    /* Set the supp page table entries */
-    for (i = vaddr; i < vaddr + length; i += PGSIZE)
-    {
-      page_supp_set (t -> spd, i, mid, PAG_FILE, i - vaddr, true, true);
-    }
-
     f -> eax = mid;
     return;
   }
@@ -535,44 +584,197 @@ sys_munmap_handler(void **args, struct intr_frame *f)
   return;
 }
 
-void munmap_kernel (mapid_t mid)
+/* Maps LENGTH bytes of zeroed memory at page-aligned ADDR, or
+   wherever there is room if ADDR is null.  Returns the address
+   mapped, or a null pointer.  The pages are swap-backed like the
+   stack. */
+void
+sys_mmap_anon_handler(void **args, struct intr_frame *f)
+{
+  void *addr = *((void **)args[0]);
+  size_t length = *((size_t *)args[1]);
+  struct thread *t = thread_current();
+  mapid_t mid;
+
+  f -> eax = 0;
+  if (length == 0 || length > (size_t) (STK_LIM_ADDR - PGSIZE))
+    return;
+  if (addr == NULL)
+    addr = page_vma_find_gap(t, length);
+  else if (pg_ofs (addr) != 0 || addr < (void *) PGSIZE
+           || addr > STK_LIM_ADDR - length)
+    return;
+  if (addr == NULL)
+    return;
+
+  mid = mmap_alloc_id(t);
+  if (mid < 0 || !page_vma_add (t, addr, length, 0, 0, true, mid))
+    return;
+  (t->mmap_table[mid]).mfile = NULL;
+  (t->mmap_table[mid]).start_vaddr = addr;
+  f -> eax = (uint32_t) addr;
+}
+
+/* Removes the anonymous mapping that starts at ADDR. */
+void
+sys_munmap_anon_handler(void **args, struct intr_frame *f UNUSED)
+{
+  void *addr = *((void **)args[0]);
+  struct thread *t = thread_current();
+  int j;
+
+  for (j = 2; j < NO_FILE_MAX; j++)
+    if ((t->mmap_table[j]).start_vaddr == addr && addr != NULL
+        && (t->mmap_table[j]).mfile == NULL)
+    {
+      munmap_kernel(j);
+      return;
+    }
+}
+
+/* Moves the end of the heap by INCREMENT bytes.  Returns the old
+   end, or (void *) -1 if the heap cannot grow that far. */
+void
+sys_sbrk_handler(void **args, struct intr_frame *f)
 {
+  intptr_t increment = *((intptr_t *)args[0]);
   struct thread *t = thread_current();
+  uint8_t *old_brk = t -> brk;
+  uint8_t *new_brk = old_brk + increment;
+
+  f -> eax = (uint32_t) -1;
+  if (t -> heap_start == NULL
+      || (increment < 0 ? new_brk > old_brk || new_brk < t -> heap_start
+                        : new_brk < old_brk))
+    return;
+  if (page_heap_resize(t, new_brk))
+    f -> eax = (uint32_t) old_brk;
+}
+
+/* Gives ADVICE about the LENGTH bytes at ADDR.  Returns 0, or -1
+   if the range is not all mapped or the advice is unknown. */
+void
+sys_madvise_handler(void **args, struct intr_frame *f)
+{
+  uint8_t *addr = *((uint8_t **)args[0]);
+  size_t length = *((size_t *)args[1]);
+  int advice = *((int *)args[2]);
+  struct thread *t = thread_current();
+  int j;
+
+  /* Pages about to be dropped must not take their changes with
+     them. */
+  if (advice == MADV_DONTNEED)
+    for (j = 2; j < NO_FILE_MAX; j++)
+    {
+      uint8_t *start = (t->mmap_table[j]).start_vaddr;
+
+      if (start != NULL && (t->mmap_table[j]).mfile != NULL
+          && start < addr + length
+          && start + page_vma_length(t, start) > addr)
+        mmap_write_back(t, j);
+    }
+
+  f -> eax = page_madvise(t, addr, length, advice) ? 0 : -1;
+}
+
+void
+sys_msync_handler(void **args, struct intr_frame *f UNUSED)
+{
+  mapid_t mid = *((int *)args[0]);
+  struct thread *t = thread_current();
+
+  if (mid >= 2 && mid < NO_FILE_MAX
+      && (t -> mmap_table[mid]).start_vaddr != NULL)
+    mmap_write_back(t, mid);
+}
+
+/* Writes the dirty pages of mapping MID of T, the running
+   process, back to its file, each run of adjacent ones as one
+   write, and marks them clean. */
+static void
+mmap_write_back (struct thread *t, mapid_t mid)
+{
   void *vaddr = (t -> mmap_table[mid]).start_vaddr;
   void *lpa;
   struct file *mf = (t -> mmap_table[mid]).mfile;
-  int flen = file_length(mf);
+  int flen;
+  void *kpages[MUNMAP_BATCH];
+  int run_ofs = 0, run_cnt = 0;
+
+  if (mf == NULL)
+    return;
+  flen = file_length(mf);
 
-  /* Write the dirty pages back to filesystem */
+  /* Pin the dirty pages, so that they stay put while we write
+     them under filesys_lock. */
   for (lpa = vaddr; lpa < vaddr + flen; lpa += PGSIZE)
+    if (pagedir_get_page(t -> pagedir, lpa) != NULL
+        && pagedir_is_dirty(t -> pagedir, lpa))
+      frame_pin_range(t, lpa, PGSIZE, false);
+
+  /* The pass goes one page past the end to write out the last
+     run.  A page is marked clean before it is written, so that a
+     write to it meanwhile marks it dirty again. */
+  lock_acquire(&filesys_lock);
+  pagedir_batch_begin();
+  for (lpa = vaddr; lpa < vaddr + flen + PGSIZE; lpa += PGSIZE)
   {
-    void *kpage = pagedir_get_page(t -> pagedir, lpa);
-    if (kpage != NULL && pagedir_is_dirty(t -> pagedir, lpa))
-    {
-      int offt = lpa - vaddr;
-      int write_size = (flen - offt) > PGSIZE ? PGSIZE : (flen - offt);
-      
-      lock_acquire(&filesys_lock);
+    void *kpage = NULL;
 
-      file_seek(mf, offt);
-      file_write(mf, lpa, write_size);
+    if (lpa < vaddr + flen && pagedir_is_dirty(t -> pagedir, lpa))
+      kpage = pagedir_get_page(t -> pagedir, lpa);
+    if (kpage != NULL && run_cnt == 0)
+      run_ofs = lpa - vaddr;
+    if (kpage != NULL)
+    {
+      pagedir_set_dirty(t -> pagedir, lpa, false);
+      kpages[run_cnt++] = kpage;
+    }
 
-      lock_release(&filesys_lock);
+    if (run_cnt > 0 && (kpage == NULL || run_cnt == MUNMAP_BATCH))
+    {
+      int write_size = flen - run_ofs;
+      if (write_size > run_cnt * PGSIZE)
+        write_size = run_cnt * PGSIZE;
+      file_write_pages(mf, kpages, write_size, run_ofs);
+      run_cnt = 0;
     }
   }
+  pagedir_batch_end();
+  lock_release(&filesys_lock);
+
+  frame_unpin_range(t, vaddr, flen);
+}
 
-  /* Clear the spd and pagedir entries(including mem) */
+void munmap_kernel (mapid_t mid)
+{
+  struct thread *t = thread_current();
+  void *vaddr = (t -> mmap_table[mid]).start_vaddr;
+  void *lpa;
+  struct file *mf = (t -> mmap_table[mid]).mfile;
+  int flen = page_vma_length(t, vaddr);
+
+  mmap_write_back(t, mid);
+
+  /* Drop the region first, so that its pages cannot come back,
+     then clear the spd and pagedir entries(including mem) */
+  page_vma_remove(t, vaddr);
+  pagedir_batch_begin();
   for (lpa = vaddr; lpa < vaddr + flen; lpa += PGSIZE)
   {
+    frame_free_page(t, lpa);
     page_supp_clear_page(t -> spd, lpa);
-    if (pagedir_get_page(t -> pagedir, lpa))
-      pagedir_clear_page(t -> pagedir, lpa);
   } 
+  pagedir_batch_end();
 
   /* Close extra instance of file for map */
-  lock_acquire(&filesys_lock);
-  file_close(mf);
-  lock_release(&filesys_lock);
+  if (mf != NULL)
+  {
+    lock_acquire(&filesys_lock);
+    file_close(mf);
+    lock_release(&filesys_lock);
+  }
 
   /* Unset entry in mmap table */
   (t -> mmap_table[mid]).mfile = NULL;
@@ -1,110 +1,1089 @@
 #include "frame.h"
 #include "swap.h"
 #include <debug.h>
+#include <hash.h>
 #include <stdbool.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/pte.h"
 #include "page.h"
+#include "zswap.h"
 
+/* Most frames a policy examines before giving up and taking the
+   best candidate it passed. */
+#define CLOCK_SCAN_MAX 256
+
+/* WSClock: a frame not referenced for this many timer ticks has
+   left the working set of its owner. */
+#define WSCLOCK_TAU (TIMER_FREQ / 2)
+
+/* Aging: minimum number of timer ticks between two shifts of the
+   age counters. */
+#define AGING_INTERVAL (TIMER_FREQ / 10)
+
+/* Frames frame_free_all() releases per acquisition of
+   frame_lock. */
+#define FREE_BATCH 32
+
+/* Most pages a read() or write() pins at a time.  Fewer while a
+   large part of the user pool is pinned already; see
+   frame_pin_limit(). */
+#define PIN_CHUNK 16
+
+/* Times frame_get_page() yields, with no eviction in flight and
+   nothing pinned, for memory that exiting processes may still be
+   giving back, before it gives up. */
+#define FRAME_RETRY_MAX 64
+
+/* The page-out daemon is woken when fewer than 1/PAGEOUT_LOW_DIV
+   of the user pool is free, and evicts until 1/PAGEOUT_HIGH_DIV
+   is free again. */
+#define PAGEOUT_LOW_DIV 32
+#define PAGEOUT_HIGH_DIV 16
+
+/* Timer ticks between two passes of the mmap flusher. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* One entry per frame of the user pool.  The entry for a frame
+   lives at index pg_no (kpage) - pg_no (frame_base), so it can be
+   found without searching. */
 struct frame_tabl_elem {
+	struct list_elem elem;		/* Element in the owner's frames list. */
+	struct thread *t;		/* Owner, NULL if the frame is not in use. */
+	void *upage;			/* User page mapped to this frame. */
+	bool evicting;			/* Being written back; owner must wait. */
+	bool pinned;			/* In use by the kernel; not evictable. */
+	bool flushing;			/* Being written to its mapped file. */
+	bool large;			/* Part of a 4 MB page; split before use. */
+	int64_t last_use;		/* WSClock: tick of last observed reference. */
+	uint8_t age;			/* Aging: reference history, MSB most recent. */
+
+	/* Shared read-only text pages, which have no owner. */
+	int share_cnt;			/* Number of mappers, 0 if not shared. */
+	struct hash_elem share_elem;	/* Element in share_table. */
+	disk_sector_t share_sector;	/* Inode sector of the executable. */
+	off_t share_ofs;		/* Offset of the page in the file. */
+	int share_bytes;		/* Bytes read from the file, rest zero. */
+};
+
+/* One process's mapping of a shared text page, in the process's
+   shared_pages list. */
+struct frame_share_map {
 	struct list_elem elem;
-	struct thread *t;
-	void *kpage;
 	void *upage;
-	bool second_chance;
+	struct frame_tabl_elem *fte;
 };
 
-static struct list frame_tabl;
+/* A page replacement policy.  All hooks run with frame_lock
+   held. */
+struct frame_policy {
+	const char *name;
+	struct frame_tabl_elem *(*select_victim) (void);	/* Picks a frame to evict, or null. */
+	void (*on_map) (struct frame_tabl_elem *);		/* Frame got an owner. */
+	void (*on_unmap) (struct frame_tabl_elem *);		/* Frame lost its owner. */
+	void (*on_access_scan) (void);				/* Samples accessed bits. */
+};
+
+static struct frame_tabl_elem *frame_tabl;
+static size_t frame_cnt;		/* Number of frames in the user pool. */
+static uint8_t *frame_base;		/* Kernel address of frame 0. */
 static struct lock frame_lock;
-static void *second_chance();
+static struct condition evict_done;	/* Signalled when an eviction ends. */
+static size_t clock_hand;		/* Next frame a policy examines. */
+static size_t pinned_cnt;		/* Frames pinned. */
+static size_t busy_cnt;			/* Frames being evicted or flushed. */
+static unsigned evict_gen;		/* Bumped on each evict_done signal. */
+static struct hash share_table;		/* Shared text pages by file page. */
+
+static size_t low_water, high_water;	/* Free frame watermarks. */
+static struct semaphore pageout_wake;	/* Up'd to wake the daemon. */
+static bool pageout_started;		/* Daemon is running. */
+static bool pageout_pending;		/* Daemon woken, round not over yet. */
+
+static size_t frame_evict (void *kpages[], size_t max);
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static thread_func pageout_daemon NO_RETURN;
+static thread_func flusher_daemon NO_RETURN;
+static bool frame_is_dirty (struct frame_tabl_elem *);
+static struct frame_tabl_elem *second_chance (void);
+static struct frame_tabl_elem *wsclock_select (void);
+static void wsclock_on_map (struct frame_tabl_elem *);
+static struct frame_tabl_elem *aging_select (void);
+static void aging_on_map (struct frame_tabl_elem *);
+static void aging_scan (void);
+static bool frame_split (struct frame_tabl_elem *);
+
+static const struct frame_policy policies[] =
+	{
+		{"clock", second_chance, NULL, NULL, NULL},
+		{"wsclock", wsclock_select, wsclock_on_map, NULL, NULL},
+		{"aging", aging_select, aging_on_map, NULL, aging_scan},
+		{NULL, NULL, NULL, NULL, NULL},
+	};
+
+/* Replacement policy in use, set by -vmpolicy. */
+static const struct frame_policy *policy = &policies[0];
+
+/* Returns the frame table entry for user pool page KPAGE. */
+static struct frame_tabl_elem *
+frame_lookup (void *kpage)
+{
+	size_t frame_no = pg_no (kpage) - pg_no (frame_base);
+
+	ASSERT (pg_ofs (kpage) == 0);
+	ASSERT (frame_no < frame_cnt);
+	return &frame_tabl[frame_no];
+}
+
+/* Takes FTE away from its owner. */
+static void
+frame_unmap (struct frame_tabl_elem *fte)
+{
+	if (policy -> on_unmap != NULL)
+		policy -> on_unmap (fte);
+	list_remove (&fte -> elem);
+	fte -> t = NULL;
+	if (fte -> pinned)
+		pinned_cnt--;
+	fte -> pinned = false;
+	fte -> large = false;
+}
+
+/* Returns true if FTE may be chosen as a victim. */
+static bool
+frame_evictable (struct frame_tabl_elem *fte)
+{
+	return fte -> t != NULL && !fte -> evicting && !fte -> flushing
+	       && !fte -> pinned && !fte -> large;
+}
+
+/* Wakes the threads waiting on evict_done.  frame_lock must be
+   held. */
+static void
+evict_wake (void)
+{
+	evict_gen++;
+	cond_broadcast (&evict_done, &frame_lock);
+}
+
+/* Returns the kernel address of the frame described by FTE. */
+static void *
+frame_kpage (struct frame_tabl_elem *fte)
+{
+	return frame_base + (fte - frame_tabl) * PGSIZE;
+}
 
-void 
-frame_tabl_init (void) 
+void
+frame_tabl_init (void)
 {
-	list_init(&frame_tabl);
+	frame_base = palloc_user_base ();
+	frame_cnt = palloc_user_page_cnt ();
+	frame_tabl = calloc (frame_cnt, sizeof *frame_tabl);
+	if (frame_tabl == NULL)
+		PANIC ("frame_tabl_init: out of memory");
 	lock_init(&frame_lock);
+	cond_init(&evict_done);
+	hash_init (&share_table, share_hash, share_less, NULL);
+
+	low_water = frame_cnt / PAGEOUT_LOW_DIV;
+	high_water = frame_cnt / PAGEOUT_HIGH_DIV;
+	if (low_water < 2)
+		low_water = 2;
+	if (high_water < 2 * low_water)
+		high_water = 2 * low_water;
+	sema_init (&pageout_wake, 0);
 	return;
 }
 
+/* Starts the page-out daemon and the mmap flusher.  Must be
+   called once the swap disk is ready. */
+void
+frame_pageout_start (void)
+{
+	pageout_started = true;
+	thread_create ("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+	thread_create ("flusher", PRI_DEFAULT, flusher_daemon, NULL);
+}
+
+/* Keeps the number of free user frames between the watermarks, so
+   that most faults find a free frame without evicting one
+   themselves. */
+static void
+pageout_daemon (void *aux UNUSED)
+{
+	for (;;)
+	{
+		sema_down (&pageout_wake);
+		while (palloc_user_free_cnt () < high_water)
+		{
+			void *kpages[SWAP_CLUSTER];
+			size_t cnt = frame_evict (kpages, SWAP_CLUSTER), i;
+
+			if (cnt == 0)
+				break;
+			for (i = 0; i < cnt; i++)
+				palloc_free_page (kpages[i]);
+		}
+		lock_acquire(&frame_lock);
+		pageout_pending = false;
+		lock_release(&frame_lock);
+	}
+}
+
+/* Writes back up to SWAP_CLUSTER dirty mmap frames, looking at
+   the frame table from frame START on, and returns where to go on
+   from.  The frames are marked clean and flushing under
+   frame_lock: while flushing a frame is not evicted, and its
+   owner waits before freeing it, so the owner's mapping outlives
+   the write.  A write to a page meanwhile marks it dirty again. */
+static size_t
+frame_flush_batch (size_t start)
+{
+	struct frame_tabl_elem *batch[SWAP_CLUSTER];
+	bool failed[SWAP_CLUSTER];
+	size_t cnt = 0, i, j;
+
+	lock_acquire(&frame_lock);
+	for (i = start; i < frame_cnt && cnt < SWAP_CLUSTER; i++)
+	{
+		struct frame_tabl_elem *fte = &frame_tabl[i];
+
+		if (fte -> t == NULL || fte -> evicting || fte -> flushing || fte -> large
+		    || !frame_is_dirty (fte) || !page_is_mmapped (fte -> t, fte -> upage))
+			continue;
+		fte -> flushing = true;
+		busy_cnt++;
+		pagedir_set_dirty (fte -> t -> pagedir, fte -> upage, false);
+		batch[cnt++] = fte;
+	}
+	lock_release(&frame_lock);
+
+	if (cnt == 0)
+		return i;
+
+	for (j = 0; j < cnt; j++)
+		failed[j] = !page_write_back (batch[j] -> t, batch[j] -> upage,
+					      frame_kpage (batch[j]));
+
+	lock_acquire(&frame_lock);
+	for (j = 0; j < cnt; j++)
+	{
+		if (failed[j])
+			pagedir_set_dirty (batch[j] -> t -> pagedir, batch[j] -> upage, true);
+		batch[j] -> flushing = false;
+		busy_cnt--;
+	}
+	evict_wake ();
+	lock_release(&frame_lock);
+	return i;
+}
+
+/* Every FLUSH_INTERVAL ticks, writes back the dirty pages of all
+   memory mappings, so that they do not pile up until munmap or
+   exit. */
+static void
+flusher_daemon (void *aux UNUSED)
+{
+	for (;;)
+	{
+		size_t next = 0;
+
+		timer_sleep (FLUSH_INTERVAL);
+		while (next < frame_cnt)
+			next = frame_flush_batch (next);
+	}
+}
+
+/* Selects the page replacement policy called NAME.  Returns false
+   if there is no such policy. */
+bool
+frame_set_policy (const char *name)
+{
+	const struct frame_policy *p;
+
+	for (p = policies; p -> name != NULL; p++)
+		if (!strcmp (p -> name, name))
+		{
+			policy = p;
+			return true;
+		}
+	return false;
+}
+
 bool
 set_frame (struct thread* t, void *upage, void *kpage)
 {
 	lock_acquire(&frame_lock);
-	struct frame_tabl_elem *fte = malloc(sizeof(struct frame_tabl_elem));
+	struct frame_tabl_elem *fte = frame_lookup (kpage);
 
 	fte -> t = t;
-	fte -> kpage = kpage;
 	fte -> upage = upage;
-	list_push_front(&frame_tabl, &fte -> elem);
+	list_push_back (&t -> frames, &fte -> elem);
+	if (policy -> on_map != NULL)
+		policy -> on_map (fte);
+	lock_release(&frame_lock);
+	return true;
+}
+
+/* Records that the PTSPAN bytes of T's memory at UPAGE are mapped
+   by one 4 MB page to the frames starting at KPAGE, obtained from
+   palloc_get_large().  The frames stay out of page replacement
+   until the 4 MB page is split. */
+void
+frame_set_large (struct thread *t, void *upage, void *kpage)
+{
+	size_t i;
+
+	lock_acquire(&frame_lock);
+	for (i = 0; i < 1 << PTBITS; i++)
+	{
+		struct frame_tabl_elem *fte = frame_lookup ((uint8_t *) kpage + i * PGSIZE);
+
+		fte -> t = t;
+		fte -> upage = (uint8_t *) upage + i * PGSIZE;
+		fte -> large = true;
+		list_push_back (&t -> frames, &fte -> elem);
+		if (policy -> on_map != NULL)
+			policy -> on_map (fte);
+	}
 	lock_release(&frame_lock);
+}
+
+/* Splits the 4 MB page that FTE is part of into 4 kB pages, which
+   page replacement may then take one by one.  Returns false if
+   out of memory.  frame_lock must be held. */
+static bool
+frame_split (struct frame_tabl_elem *fte)
+{
+	struct frame_tabl_elem *first;
+	size_t i;
+
+	ASSERT (fte -> large);
+	if (!pagedir_split_large (fte -> t -> pagedir, fte -> upage))
+		return false;
+	first = frame_lookup ((void *) ((uintptr_t) frame_kpage (fte) & ~(PTSPAN - 1)));
+	for (i = 0; i < 1 << PTBITS; i++)
+		first[i].large = false;
 	return true;
 }
 
+/* Splits some 4 MB page, so that a policy that found nothing else
+   to evict has 4 kB pages to choose from.  Returns false if there
+   is none.  frame_lock must be held. */
+static bool
+frame_split_any (void)
+{
+	size_t i;
+
+	for (i = 0; i < frame_cnt; i++)
+		if (frame_tabl[i].large)
+			return frame_split (&frame_tabl[i]);
+	return false;
+}
+
 void *
 frame_get_page (enum palloc_flags flags)
-{	
-	void *kpage = palloc_get_page(flags);
-	if (kpage == NULL) {
-		//PANIC ("palloc_get: out of pages");
+{
+	void *kpage;
+	int idle = 0;
+
+	while ((kpage = palloc_get_page(flags)) == NULL) {
+		/* Evict a whole cluster while we are at it; the frames
+		   we do not need serve the next faults. */
+		void *kpages[SWAP_CLUSTER];
+		unsigned gen = evict_gen;
+		size_t cnt = frame_evict (kpages, SWAP_CLUSTER), i;
+
+		if (cnt > 0) {
+			kpage = kpages[0];
+			for (i = 1; i < cnt; i++)
+				palloc_free_page (kpages[i]);
+			if (flags & PAL_ZERO)
+				memset (kpage, 0, PGSIZE);
+			break;
+		}
+
+		/* No victim: other evictors or the flusher hold every
+		   candidate, or the rest are pinned.  Both pass; wait
+		   for one to end, then try again.  EVICT_GEN tells if
+		   one ended since we looked. */
 		lock_acquire(&frame_lock);
+		if (gen == evict_gen && (busy_cnt > 0 || pinned_cnt > 0))
+		{
+			cond_wait (&evict_done, &frame_lock);
+			idle = 0;
+		}
+		else if (gen == evict_gen)
+		{
+			/* Nothing in flight.  An exiting process may still
+			   be freeing its frames; give it a chance. */
+			lock_release(&frame_lock);
+			if (++idle > FRAME_RETRY_MAX)
+				PANIC ("frame_get_page: out of memory");
+			thread_yield ();
+			continue;
+		}
+		lock_release(&frame_lock);
+	}
 
-		struct frame_tabl_elem* evicted = second_chance();
-		kpage = evicted -> kpage;
-		if(!page_to_disk(evicted -> t, evicted->upage, evicted->kpage))
-			PANIC("SWAP SLOT ERROR");
-		pagedir_clear_page(evicted -> t -> pagedir, evicted->upage); 
-		free(evicted);
+	/* Wake the daemon once, not on every fault below the mark. */
+	if (pageout_started && palloc_user_free_cnt () < low_water)
+	{
+		bool wake;
 
+		lock_acquire(&frame_lock);
+		wake = !pageout_pending;
+		pageout_pending = true;
 		lock_release(&frame_lock);
-	}	
+		if (wake)
+			sema_up (&pageout_wake);
+	}
 
 	return kpage;
 }
 
+/* Writes the CNT frames in VICTIMS to consecutive swap slots
+   and records each slot in its owner's page table.  If swap has
+   no run of CNT free slots, the frames are swapped one by one. */
+static void
+frame_swap_out (struct frame_tabl_elem *victims[], size_t cnt)
+{
+	void *kpages[SWAP_CLUSTER];
+	int slot;
+	size_t i;
 
-static void *
-second_chance()
+	for (i = 0; i < cnt; i++)
+		kpages[i] = frame_kpage (victims[i]);
+	slot = swap_write_cluster (kpages, cnt);
+	for (i = 0; i < cnt; i++)
+	{
+		struct frame_tabl_elem *evicted = victims[i];
+
+		if (slot != -1)
+			page_set_swapped (evicted -> t, evicted -> upage, slot + i);
+		else if(!page_to_disk(evicted -> t, evicted -> upage, kpages[i]))
+			PANIC("SWAP SLOT ERROR");
+	}
+}
+
+/* Evicts up to MAX frames, at most SWAP_CLUSTER, and stores them,
+   no longer in the frame table, in KPAGES.  Returns the number of
+   frames evicted, which is 0 if no frame can be evicted.
+   The victims are chosen and claimed with frame_lock held: each
+   is marked evicting and unmapped, so its owner faults and waits
+   in frame_wait_evicted().  The write back happens without the
+   lock, letting faults on other frames proceed in parallel.
+   Victims bound for swap go out together as one cluster of
+   consecutive slots. */
+static size_t
+frame_evict (void *kpages[], size_t max)
 {
-	struct list_elem *e =NULL, *e1=NULL;
-	for(e = list_begin (&frame_tabl); e != list_end (&frame_tabl);
-       e = e1)
+	struct frame_tabl_elem *victims[SWAP_CLUSTER];
+	struct frame_tabl_elem *swapped[SWAP_CLUSTER];
+	size_t cnt, cluster_cnt = 0, i;
+
+	ASSERT (max <= SWAP_CLUSTER);
+
+	/* The scan clears many accessed bits; flush the TLB once. */
+	lock_acquire(&frame_lock);
+	pagedir_batch_begin ();
+	if (policy -> on_access_scan != NULL)
+		policy -> on_access_scan ();
+	for (cnt = 0; cnt < max; cnt++)
 	{
-		struct frame_tabl_elem *frame_elem = list_entry (e, struct frame_tabl_elem, elem);
-		if(! pagedir_is_accessed(frame_elem -> t->pagedir, frame_elem->upage))
+		struct frame_tabl_elem *evicted = policy -> select_victim ();
+		if (evicted == NULL && cnt == 0 && frame_split_any ())
+			evicted = policy -> select_victim ();
+		if (evicted == NULL)
+			break;
+		evicted -> evicting = true;
+		busy_cnt++;
+		pagedir_clear_page(evicted -> t -> pagedir, evicted -> upage);
+		victims[cnt] = evicted;
+	}
+	pagedir_batch_end ();
+	lock_release(&frame_lock);
+
+	if (cnt == 0)
+		return 0;
+
+	/* Clean pages and mmap pages are handled one at a time;
+	   swap-bound pages that compressed swap does not take are
+	   gathered into the cluster. */
+	for (i = 0; i < cnt; i++)
+	{
+		struct frame_tabl_elem *evicted = victims[i];
+
+		if (page_needs_swap (evicted -> t, evicted -> upage))
 		{
-			e1 = list_remove(e);
-			return frame_elem;
+			/* Compressed in RAM if it fits, else to disk. */
+			if (!zswap_store (evicted -> t, evicted -> upage, frame_kpage (evicted)))
+				swapped[cluster_cnt++] = evicted;
+		}
+		else if(!page_to_disk(evicted -> t, evicted -> upage, frame_kpage (evicted)))
+			PANIC("SWAP SLOT ERROR");
+	}
+	if (cluster_cnt > 0)
+		frame_swap_out (swapped, cluster_cnt);
 
+	lock_acquire(&frame_lock);
+	for (i = 0; i < cnt; i++)
+	{
+		victims[i] -> evicting = false;
+		busy_cnt--;
+		kpages[i] = frame_kpage (victims[i]);
+		frame_unmap (victims[i]);
+	}
+	evict_wake ();
+	lock_release(&frame_lock);
+
+	return cnt;
+}
+
+/* Waits until user page UPAGE of T is not being evicted.  Such a
+   page is still marked resident in T's supplemental page table
+   but is no longer present in its page directory. */
+void
+frame_wait_evicted (struct thread *t, const void *upage)
+{
+	lock_acquire(&frame_lock);
+	while (pagedir_get_page (t -> pagedir, upage) == NULL
+	       && page_supp_in_mem (t -> spd, upage))
+		cond_wait (&evict_done, &frame_lock);
+	lock_release(&frame_lock);
+}
+
+
+/* Returns the frame table entry of the frame that backs user page
+   UPAGE of T, or a null pointer if UPAGE is not present or is not
+   backed by a frame of T's own.  frame_lock must be held. */
+static struct frame_tabl_elem *
+frame_of (struct thread *t, const void *upage)
+{
+	uint8_t *kpage = pagedir_get_page (t -> pagedir, upage);
+	struct frame_tabl_elem *fte;
+
+	if (kpage == NULL || kpage < frame_base
+	    || kpage >= frame_base + frame_cnt * PGSIZE)
+		return NULL;
+	fte = frame_lookup (kpage);
+	return fte -> t == t ? fte : NULL;
+}
+
+/* Faults in every page of the SIZE bytes of user memory at UADDR,
+   T's, and pins them so that they stay resident until
+   frame_unpin_range().  WRITE is true if the kernel will write
+   the buffer, so that pages still on the shared zero page get
+   frames of their own.  Each page is touched like any user access
+   would, so a bad buffer kills T in the page fault handler, and
+   the stack grows as usual.  Meant to be called before taking
+   filesys_lock: faults on the pinned buffer then cannot happen
+   while it is held.  Pages without a frame of T's own, such as
+   shared text, are never evicted and are left as they are. */
+void
+frame_pin_range (struct thread *t, const void *uaddr, size_t size, bool write)
+{
+	uint8_t *upage;
+
+	if (size == 0)
+		return;
+	for (upage = pg_round_down (uaddr);
+	     upage <= (uint8_t *) uaddr + size - 1; upage += PGSIZE)
+	{
+		for (;;)
+		{
+			struct frame_tabl_elem *fte;
+			volatile uint8_t *p = upage;
+
+			if (write)
+				*p = *p;
+			else
+				(void) *p;
+
+			lock_acquire(&frame_lock);
+			if (pagedir_get_page (t -> pagedir, upage) != NULL)
+			{
+				fte = frame_of (t, upage);
+				if (fte != NULL && !fte -> pinned)
+				{
+					fte -> pinned = true;
+					pinned_cnt++;
+				}
+				lock_release(&frame_lock);
+				break;
+			}
+			/* Evicted since we touched it; try again. */
+			lock_release(&frame_lock);
 		}
-		else
+	}
+}
+
+/* Returns how many pages a caller should pin with one
+   frame_pin_range() call: PIN_CHUNK, but no more than half of the
+   frames not pinned yet, so that pinners together never leave
+   eviction without a victim.  Always at least 1. */
+size_t
+frame_pin_limit (void)
+{
+	size_t limit;
+
+	lock_acquire(&frame_lock);
+	limit = (frame_cnt - pinned_cnt) / 2;
+	lock_release(&frame_lock);
+	if (limit > PIN_CHUNK)
+		limit = PIN_CHUNK;
+	return limit > 0 ? limit : 1;
+}
+
+/* Unpins the pages pinned by frame_pin_range (T, UADDR, SIZE). */
+void
+frame_unpin_range (struct thread *t, const void *uaddr, size_t size)
+{
+	uint8_t *upage;
+
+	if (size == 0)
+		return;
+	lock_acquire(&frame_lock);
+	for (upage = pg_round_down (uaddr);
+	     upage <= (uint8_t *) uaddr + size - 1; upage += PGSIZE)
+	{
+		struct frame_tabl_elem *fte = frame_of (t, upage);
+
+		if (fte != NULL && fte -> pinned)
+		{
+			fte -> pinned = false;
+			pinned_cnt--;
+		}
+	}
+	/* A frame_get_page() may be waiting for a victim. */
+	evict_wake ();
+	lock_release(&frame_lock);
+}
+
+/* Makes the resident pages among the SIZE bytes of user memory at
+   UADDR, T's, the first candidates for eviction: clears their
+   accessed bits and ages them as if long unused. */
+void
+frame_deactivate_range (struct thread *t, const void *uaddr, size_t size)
+{
+	uint8_t *upage;
+
+	if (size == 0)
+		return;
+	lock_acquire(&frame_lock);
+	pagedir_batch_begin ();
+	for (upage = pg_round_down (uaddr);
+	     upage <= (uint8_t *) uaddr + size - 1; upage += PGSIZE)
+	{
+		struct frame_tabl_elem *fte = frame_of (t, upage);
+
+		if (fte == NULL || fte -> large)
+			continue;
+		pagedir_set_accessed (t -> pagedir, upage, false);
+		fte -> age = 0;
+		fte -> last_use = 0;
+	}
+	pagedir_batch_end ();
+	lock_release(&frame_lock);
+}
+
+/* Returns true if the page in FTE has been written since it was
+   mapped, so evicting it costs a write back. */
+static bool
+frame_is_dirty (struct frame_tabl_elem *fte)
+{
+	return pagedir_is_dirty (fte -> t -> pagedir, fte -> upage);
+}
+
+/* Picks a victim frame with the clock algorithm.  The hand
+   persists across evictions: it advances over the frame table,
+   clearing accessed bits, and stops at the first in-use frame
+   that is neither accessed nor dirty.  Unaccessed dirty frames
+   are passed over, as evicting them costs a write.  At most
+   CLOCK_SCAN_MAX frames are examined; if no clean frame
+   qualifies, the first unaccessed dirty frame is taken, else the
+   first frame the hand passed, since its bit was cleared longest
+   ago.  Returns a null pointer if no frame can be evicted. */
+static struct frame_tabl_elem *
+second_chance (void)
+{
+	struct frame_tabl_elem *dirty = NULL, *fallback = NULL;
+	size_t i, seen = 0;
+
+	for (i = 0; i < frame_cnt && seen < CLOCK_SCAN_MAX; i++)
+	{
+		struct frame_tabl_elem *frame_elem = &frame_tabl[clock_hand];
+		clock_hand = (clock_hand + 1) % frame_cnt;
+
+		if (!frame_evictable (frame_elem))
+			continue;
+		seen++;
+
+		if(! pagedir_is_accessed(frame_elem -> t->pagedir, frame_elem->upage))
+		{
+			if (!frame_is_dirty (frame_elem))
+				return frame_elem;
+			if (dirty == NULL)
+				dirty = frame_elem;
+			continue;
+		}
+
+		pagedir_set_accessed(frame_elem -> t->pagedir, frame_elem->upage, false);
+		if (fallback == NULL)
+			fallback = frame_elem;
+	}
+
+	return dirty != NULL ? dirty : fallback;
+}
+
+static void
+wsclock_on_map (struct frame_tabl_elem *fte)
+{
+	fte -> last_use = timer_ticks ();
+}
+
+/* WSClock: like the clock, but a frame whose accessed bit is clear
+   is only taken once it has gone unreferenced for WSCLOCK_TAU
+   ticks.  Referenced frames get their time of last use refreshed.
+   An old clean frame is taken at once; failing that, the first old
+   dirty frame, then the least recently used frame passed. */
+static struct frame_tabl_elem *
+wsclock_select (void)
+{
+	struct frame_tabl_elem *dirty = NULL, *fallback = NULL;
+	int64_t now = timer_ticks ();
+	size_t i, seen = 0;
+
+	for (i = 0; i < frame_cnt && seen < CLOCK_SCAN_MAX; i++)
+	{
+		struct frame_tabl_elem *frame_elem = &frame_tabl[clock_hand];
+		clock_hand = (clock_hand + 1) % frame_cnt;
+
+		if (!frame_evictable (frame_elem))
+			continue;
+		seen++;
+
+		if (pagedir_is_accessed(frame_elem -> t->pagedir, frame_elem->upage))
 		{
 			pagedir_set_accessed(frame_elem -> t->pagedir, frame_elem->upage, false);
-			e1 = list_remove(e);
-			list_push_back(&frame_tabl, e);
+			frame_elem -> last_use = now;
+		}
+		else if (now - frame_elem -> last_use > WSCLOCK_TAU)
+		{
+			if (!frame_is_dirty (frame_elem))
+				return frame_elem;
+			if (dirty == NULL)
+				dirty = frame_elem;
 		}
+
+		if (fallback == NULL || frame_elem -> last_use < fallback -> last_use)
+			fallback = frame_elem;
+	}
+
+	return dirty != NULL ? dirty : fallback;
+}
+
+static void
+aging_on_map (struct frame_tabl_elem *fte)
+{
+	fte -> age = 0x80;
+}
+
+/* Aging: shifts each in-use frame's accessed bit into the top of
+   its age counter and clears the accessed bit.  Runs at most once
+   every AGING_INTERVAL ticks so that the history spans time, not
+   evictions. */
+static void
+aging_scan (void)
+{
+	static int64_t last_scan;
+	int64_t now = timer_ticks ();
+	size_t i;
+
+	if (last_scan != 0 && now - last_scan < AGING_INTERVAL)
+		return;
+	last_scan = now;
+
+	for (i = 0; i < frame_cnt; i++)
+	{
+		struct frame_tabl_elem *frame_elem = &frame_tabl[i];
+		bool accessed;
+
+		if (frame_elem -> t == NULL || frame_elem -> large)
+			continue;
+		accessed = pagedir_is_accessed(frame_elem -> t->pagedir, frame_elem->upage);
+		frame_elem -> age = (frame_elem -> age >> 1) | (accessed ? 0x80 : 0);
+		if (accessed)
+			pagedir_set_accessed(frame_elem -> t->pagedir, frame_elem->upage, false);
 	}
+}
+
+/* Aging: takes the first clean frame with an all-zero history, or
+   else the frame with the smallest age among those examined,
+   preferring clean frames among equals. */
+static struct frame_tabl_elem *
+aging_select (void)
+{
+	struct frame_tabl_elem *victim = NULL;
+	size_t i, seen = 0;
+
+	for (i = 0; i < frame_cnt && seen < CLOCK_SCAN_MAX; i++)
+	{
+		struct frame_tabl_elem *frame_elem = &frame_tabl[clock_hand];
+		clock_hand = (clock_hand + 1) % frame_cnt;
+
+		if (!frame_evictable (frame_elem))
+			continue;
+		seen++;
+
+		bool dirty = frame_is_dirty (frame_elem);
+		if (frame_elem -> age == 0 && !dirty)
+			return frame_elem;
+		if (victim == NULL || frame_elem -> age < victim -> age
+		    || (frame_elem -> age == victim -> age && !dirty
+			&& frame_is_dirty (victim)))
+			victim = frame_elem;
+	}
+
+	return victim;
+}
+
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct frame_tabl_elem *fte =
+		hash_entry (e, struct frame_tabl_elem, share_elem);
+	return hash_int (fte -> share_sector) ^ hash_int (fte -> share_ofs);
+}
+
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+	    void *aux UNUSED)
+{
+	const struct frame_tabl_elem *a =
+		hash_entry (a_, struct frame_tabl_elem, share_elem);
+	const struct frame_tabl_elem *b =
+		hash_entry (b_, struct frame_tabl_elem, share_elem);
+
+	if (a -> share_sector != b -> share_sector)
+		return a -> share_sector < b -> share_sector;
+	if (a -> share_ofs != b -> share_ofs)
+		return a -> share_ofs < b -> share_ofs;
+	return a -> share_bytes < b -> share_bytes;
+}
+
+/* Returns the shared text page for the given file page, or a
+   null pointer if it is not cached.  frame_lock must be held. */
+static struct frame_tabl_elem *
+share_find (disk_sector_t sector, off_t ofs, int read_bytes)
+{
+	struct frame_tabl_elem key;
+	struct hash_elem *e;
+
+	key.share_sector = sector;
+	key.share_ofs = ofs;
+	key.share_bytes = read_bytes;
+	e = hash_find (&share_table, &key.share_elem);
+	return e != NULL ? hash_entry (e, struct frame_tabl_elem, share_elem) : NULL;
+}
+
+/* Records that T maps shared text page FTE at UPAGE.  Returns
+   false if out of memory.  frame_lock must be held. */
+static bool
+share_map (struct thread *t, void *upage, struct frame_tabl_elem *fte)
+{
+	struct frame_share_map *map = malloc (sizeof *map);
+
+	if (map == NULL)
+		return false;
+	map -> upage = upage;
+	map -> fte = fte;
+	fte -> share_cnt++;
+	list_push_back (&t -> shared_pages, &map -> elem);
+	return true;
+}
+
+/* Undoes MAP, T's mapping of a shared text page, and frees the
+   page if T was its last mapper.  frame_lock must be held. */
+static void
+share_unmap (struct thread *t, struct frame_share_map *map)
+{
+	struct frame_tabl_elem *fte = map -> fte;
+
+	list_remove (&map -> elem);
+	pagedir_clear_page (t -> pagedir, map -> upage);
+	if (--fte -> share_cnt == 0)
+	{
+		hash_delete (&share_table, &fte -> share_elem);
+		palloc_free_page (frame_kpage (fte));
+	}
+	free (map);
+}
+
+/* Returns T's mapping of a shared text page at UPAGE, or a null
+   pointer if there is none.  frame_lock must be held. */
+static struct frame_share_map *
+share_lookup (struct thread *t, const void *upage)
+{
+	struct list_elem *e;
+
+	for (e = list_begin (&t -> shared_pages); e != list_end (&t -> shared_pages);
+	     e = list_next (e))
+	{
+		struct frame_share_map *map = list_entry (e, struct frame_share_map, elem);
+		if (map -> upage == upage)
+			return map;
+	}
+	return NULL;
+}
 
+/* Maps UPAGE of T to the shared copy of a read-only text page:
+   READ_BYTES bytes at offset OFS of the executable whose inode is
+   at SECTOR, followed by zeros.  Returns the copy's kernel
+   address, to be installed read-only in T's page directory, or a
+   null pointer if no copy is cached. */
+void *
+frame_share_get (struct thread *t, void *upage, disk_sector_t sector,
+		 off_t ofs, int read_bytes)
+{
+	struct frame_tabl_elem *fte;
+	void *kpage = NULL;
+
+	lock_acquire(&frame_lock);
+	fte = share_find (sector, ofs, read_bytes);
+	if (fte != NULL && share_map (t, upage, fte))
+		kpage = frame_kpage (fte);
+	lock_release(&frame_lock);
+	return kpage;
+}
+
+/* Offers KPAGE, a frame from frame_get_page() holding the text
+   page described as for frame_share_get(), to the cache, and maps
+   UPAGE of T to the cached copy.  Returns the cached copy, which
+   is not KPAGE if another process cached the page first, in which
+   case the caller frees KPAGE.  Returns a null pointer if out of
+   memory; KPAGE then stays with the caller, as a private page.
+   Shared pages are never evicted: the frame goes back to the user
+   pool when its last mapper goes away. */
+void *
+frame_share_add (struct thread *t, void *upage, disk_sector_t sector,
+		 off_t ofs, int read_bytes, void *kpage)
+{
+	struct frame_tabl_elem *fte;
+	void *shared = NULL;
+
+	lock_acquire(&frame_lock);
+	fte = share_find (sector, ofs, read_bytes);
+	if (fte == NULL)
+	{
+		fte = frame_lookup (kpage);
+		ASSERT (fte -> t == NULL && fte -> share_cnt == 0);
+		fte -> share_sector = sector;
+		fte -> share_ofs = ofs;
+		fte -> share_bytes = read_bytes;
+		if (share_map (t, upage, fte))
+			hash_insert (&share_table, &fte -> share_elem);
+		else
+			fte = NULL;
+	}
+	else if (!share_map (t, upage, fte))
+		fte = NULL;
+	if (fte != NULL)
+		shared = frame_kpage (fte);
+	lock_release(&frame_lock);
+	return shared;
 }
 
+/* Unmaps every shared text page T maps, and frees the pages that
+   have no mapper left.  Must run while T still denies writes to
+   its executable, so that no cached page goes stale. */
 void
-frame_free_all(struct thread* t)
+frame_unshare_all (struct thread *t)
 {
 	lock_acquire(&frame_lock);
+	pagedir_batch_begin ();
+	while (!list_empty (&t -> shared_pages))
+		share_unmap (t, list_entry (list_front (&t -> shared_pages),
+					    struct frame_share_map, elem));
+	pagedir_batch_end ();
+	lock_release(&frame_lock);
+}
 
-	struct list_elem *e =NULL, *e1=NULL;
+/* Unmaps user page UPAGE of T and, if it was resident, removes
+   its frame from the frame table and returns it to the user pool.
+   A shared text page is only unshared, and freed once it has no
+   mapper left.  Waits for an eviction or flush of the page in
+   progress to finish first. */
+void
+frame_free_page (struct thread *t, void *upage)
+{
+	struct frame_tabl_elem *fte = NULL;
+	void *kpage;
 
-	for (e = list_begin (&frame_tabl); e != list_end (&frame_tabl);
-       e = e1)
+	lock_acquire(&frame_lock);
+	while ((kpage = pagedir_get_page (t -> pagedir, upage)) == NULL
+	       ? page_supp_in_mem (t -> spd, upage)
+	       : (fte = frame_of (t, upage)) != NULL && fte -> flushing)
+		cond_wait (&evict_done, &frame_lock);
+	/* No frame of T's own if UPAGE maps the zero page or shared
+	   text. */
+	fte = kpage != NULL ? frame_of (t, upage) : NULL;
+	if (fte != NULL && fte -> large && !frame_split (fte))
+		PANIC ("out of memory splitting a 4 MB page");
+	if (kpage != NULL)
 	{
-		
-		struct frame_tabl_elem *frame_elem = list_entry (e, struct frame_tabl_elem, elem);
+		struct frame_share_map *map;
 
-		if( frame_elem -> t == t)
+		if (fte != NULL)
 		{
-			e1 = list_remove(e);
-			free(frame_elem);
+			pagedir_clear_page (t -> pagedir, upage);
+			frame_unmap (fte);
 		}
+		else if ((map = share_lookup (t, upage)) != NULL)
+			share_unmap (t, map);
 		else
-			e1 = e->next;
+			pagedir_clear_page (t -> pagedir, upage);
 	}
-
 	lock_release(&frame_lock);
-}
\ No newline at end of file
+
+	if (fte != NULL)
+		palloc_free_page (kpage);
+}
+
+/* Drops every frame owned by T from the frame table.  Only T's own
+   frames are visited, and frame_lock is given up every FREE_BATCH
+   frames so that faulting processes are not held up by a large
+   exit.  Frames being evicted or flushed are waited for, since
+   their write back still uses T's supplemental page table.  The frames
+   themselves are freed with T's page directory. */
+void
+frame_free_all(struct thread* t)
+{
+	bool done = false;
+
+	while (!done)
+	{
+		struct list_elem *e, *next;
+		int i = 0;
+
+		lock_acquire(&frame_lock);
+		for (e = list_begin (&t -> frames);
+		     e != list_end (&t -> frames) && i < FREE_BATCH; e = next)
+		{
+			struct frame_tabl_elem *frame_elem =
+				list_entry (e, struct frame_tabl_elem, elem);
+			next = list_next (e);
+			if (!frame_elem -> evicting && !frame_elem -> flushing)
+			{
+				frame_unmap (frame_elem);
+				i++;
+			}
+		}
+		if (i == 0 && !list_empty (&t -> frames))
+			cond_wait (&evict_done, &frame_lock);
+		done = list_empty (&t -> frames);
+		lock_release(&frame_lock);
+	}
+}
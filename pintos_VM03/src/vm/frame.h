@@ -5,9 +5,28 @@
 #include "threads/palloc.h"
 #include "userprog/pagedir.h"
 #include "threads/synch.h"
+#include "devices/disk.h"
+#include "filesys/off_t.h"
 
 void frame_tabl_init (void) ;
+bool frame_set_policy (const char *name);
+void frame_pageout_start (void);
 bool set_frame (struct thread* t, void *upage, void *kpage);
+void frame_set_large (struct thread *t, void *upage, void *kpage);
 void *frame_get_page (enum palloc_flags flags);
 
+void frame_wait_evicted (struct thread *t, const void *upage);
+void frame_pin_range (struct thread *t, const void *uaddr, size_t size,
+			bool write);
+size_t frame_pin_limit (void);
+void frame_unpin_range (struct thread *t, const void *uaddr, size_t size);
+void frame_deactivate_range (struct thread *t, const void *uaddr,
+			size_t size);
+void frame_free_page (struct thread *t, void *upage);
 void frame_free_all(struct thread* t);
+
+void *frame_share_get (struct thread *t, void *upage, disk_sector_t sector,
+			off_t ofs, int read_bytes);
+void *frame_share_add (struct thread *t, void *upage, disk_sector_t sector,
+			off_t ofs, int read_bytes, void *kpage);
+void frame_unshare_all (struct thread *t);
@@ -2,16 +2,29 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <round.h>
 #include "threads/init.h"
+#include "threads/malloc.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
+#include "vm/frame.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
 #include "lib/user/syscall.h"
 
+/* A page of zeros, mapped read-only for PAG_ZERO pages until they
+   are first written. */
+static void *zero_page;
+
+/* Back anonymous regions with 4 MB pages where they can, set by
+   -largepages. */
+bool page_large = false;
+
 struct sup_pt_entry
 { 
   uint32_t o_pte;     /* Contains the swap slot number (swap based) / page-zero bytes(file-based) */
@@ -27,6 +40,40 @@ set_in_mem_bit (uint32_t o_pte, bool bit) {
     return o_pte | aux;
 }
 
+static uint32_t
+set_zero_map_bit (uint32_t o_pte, bool bit) {
+  if (bit)
+    return o_pte | (1 << ZERO_MAP_BIT);
+  else
+    return o_pte & ~(1 << ZERO_MAP_BIT);
+}
+
+static uint32_t
+set_zswap_bit (uint32_t o_pte, bool bit) {
+  if (bit)
+    return o_pte | (1 << ZSWAP_BIT);
+  else
+    return o_pte & ~(1 << ZSWAP_BIT);
+}
+
+static uint32_t
+set_swap_cache_bit (uint32_t o_pte, bool bit) {
+  if (bit)
+    return o_pte | (1 << SWAP_CACHE_BIT);
+  else
+    return o_pte & ~(1 << SWAP_CACHE_BIT);
+}
+
+/* Returns true if O_PTE owns a swap slot: either the page is
+   swapped out to disk, or it is resident and its slot is still
+   cached. */
+static bool
+spte_owns_slot (uint32_t o_pte)
+{
+  return SPT_FLAG(o_pte) == PAG_SWAP && !SPT_ZSWAPPED(o_pte)
+         && (!SPT_IN_MEM(o_pte) || SPT_SWAP_CACHED(o_pte));
+}
+
 static uint32_t 
 spte_create_user(int aux, enum spd_flags flags, bool writable, bool mmap)  // IN_MEM bit is zero
 {
@@ -50,10 +97,20 @@ page_supp_create (void)
   return pd;
 }
 
+/* Allocates the shared zero page. */
+void
+page_zero_init (void)
+{
+  zero_page = palloc_get_page (PAL_ZERO);
+  if (zero_page == NULL)
+    PANIC ("page_zero_init: out of memory");
+}
+
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  Mappings of the shared zero page are cleared from
+   page directory PD, so that destroying PD does not free it. */
 void
-page_supp_destroy (uint32_t *spd) 
+page_supp_destroy (uint32_t *spd, uint32_t *pd) 
 {
   uint32_t *spde;
 
@@ -67,8 +124,19 @@ page_supp_destroy (uint32_t *spd)
         struct sup_pt_entry *spte;
         
         for (spte = spt; spte < spt + 2 * PGSIZE / sizeof *spte; spte++)
-          if (SPT_FLAG(spte -> o_pte) == PAG_SWAP && !SPT_IN_MEM(spte-> o_pte) )
-            swap_free(spte -> o_pte & SECT_BITS);
+          {
+            void *upage = (void *) (((uintptr_t) (spde - spd) << PDSHIFT)
+                                    | ((uintptr_t) (spte - (struct sup_pt_entry *) spt) << PTSHIFT));
+
+            /* SPD is the running process's; a compressed copy may be
+               written back to a slot while we free it. */
+            if (SPT_ZSWAPPED(spte -> o_pte))
+              zswap_free (thread_current (), upage);
+            if (spte_owns_slot (spte -> o_pte))
+              swap_free(spte -> o_pte & SECT_BITS);
+            else if (pd != NULL && SPT_ZERO_MAPPED(spte -> o_pte))
+              pagedir_clear_page (pd, upage);
+          }
         palloc_free_multiple (spt, sizeof(struct sup_pt_entry) / sizeof(uint32_t));
       }
   palloc_free_page (spd);
@@ -164,8 +232,125 @@ page_supp_set (uint32_t *spd, void *upage, int aux,
     return false;
 }
 
+/* Returns true if evicting user page UPAGE of T means writing it
+   to swap: it has been written, or came from swap without keeping
+   its slot, and has no file to go back to. */
+bool
+page_needs_swap (struct thread *t, void *upage)
+{
+  struct sup_pt_entry *spte = lookup_page (t -> spd, upage, false);
+  bool dirty;
+
+  if (spte == NULL)
+    return false;
+
+  dirty = pagedir_is_dirty(t -> pagedir, upage);
+  switch (SPT_FLAG(spte -> o_pte))
+    {
+    case PAG_ZERO:
+      return dirty;
+    case PAG_SWAP:
+      return dirty || !SPT_SWAP_CACHED(spte -> o_pte);
+    case PAG_FILE:
+      /* Executable pages written to by the program (data
+         segment) cannot go back to the executable. */
+      return dirty && !SPT_MMAPPED(spte -> o_pte);
+    default:
+      return false;
+    }
+}
+
+/* Records that user page UPAGE of T, which is being evicted, now
+   lives in swap slot SWAP_SLOT.  A stale cached slot is freed. */
+void
+page_set_swapped (struct thread *t, void *upage, int swap_slot)
+{
+  struct sup_pt_entry *spte = lookup_page (t -> spd, upage, false);
+  bool writable;
+
+  ASSERT (spte != NULL);
+  writable = SPT_WRITABLE(spte -> o_pte);
+
+  /* A cached copy is stale once the page is dirty. */
+  if (SPT_SWAP_CACHED(spte -> o_pte))
+    swap_free(spte -> o_pte & SECT_BITS);
+
+  spte -> o_pte = spte_create_user(swap_slot, PAG_SWAP, writable, 0); // IN_MEM bit is 0
+  spte -> file_offt = 0;
+}
+
+/* Records that user page UPAGE of T, which is being evicted, now
+   lives in compressed swap, at arena offset HANDLE. */
+void
+page_set_zswapped (struct thread *t, void *upage, int handle)
+{
+  struct sup_pt_entry *spte;
+
+  page_set_swapped (t, upage, handle);
+  spte = lookup_page (t -> spd, upage, false);
+  spte -> o_pte = set_zswap_bit (spte -> o_pte, true);
+}
+
+/* Returns the compressed swap handle of user page UPAGE of T, or
+   -1 if the page is not in compressed swap. */
+int
+page_zswap_handle (struct thread *t, void *upage)
+{
+  struct sup_pt_entry *spte = lookup_page (t -> spd, upage, false);
+
+  if (spte == NULL || SPT_FLAG(spte -> o_pte) != PAG_SWAP
+      || SPT_IN_MEM(spte -> o_pte) || !SPT_ZSWAPPED(spte -> o_pte))
+    return -1;
+  return spte -> o_pte & SECT_BITS;
+}
+
+/* Writes KPAGE, the contents of mmap page SPTE of T, back to the
+   mapped file.  Returns false if the write falls short. */
+static bool
+mmap_write (struct thread *t, struct sup_pt_entry *spte, void *kpage)
+{
+  mapid_t mid = spte -> o_pte & SECT_BITS;
+  struct file *mf = (t -> mmap_table[mid]).mfile;
+
+  lock_acquire(&filesys_lock);
+  
+  int write_size, flen = file_length(mf);
+  write_size = (flen - spte -> file_offt) > PGSIZE ? PGSIZE : (flen - spte -> file_offt);
+  /* The page may belong to another process, write from KPAGE. */
+  int len_written = file_write_at(mf, kpage, write_size, spte -> file_offt);
+  
+  lock_release(&filesys_lock);
+
+  return len_written == write_size;
+}
+
+/* Returns true if user page UPAGE of T belongs to a memory
+   mapping. */
+bool
+page_is_mmapped (struct thread *t, void *upage)
+{
+  struct sup_pt_entry *spte = lookup_page (t -> spd, upage, false);
+
+  return spte != NULL && SPT_FLAG(spte -> o_pte) == PAG_FILE
+         && SPT_MMAPPED(spte -> o_pte);
+}
+
+/* Writes mmap page UPAGE of T, resident in KPAGE, back to its
+   file, leaving it resident.  Returns false if the write falls
+   short. */
+bool
+page_write_back (struct thread *t, void *upage, void *kpage)
+{
+  struct sup_pt_entry *spte = lookup_page (t -> spd, upage, false);
+
+  ASSERT (page_is_mmapped (t, upage));
+  return mmap_write (t, spte, kpage);
+}
+
 /* When a frame is being written back to disk, if it is not a file_system page, the corresponding kpage is written 
-to an empty swap slot and the entry in suplemental page table is updated */
+to an empty swap slot and the entry in suplemental page table is updated.
+Clean file and zero pages are dropped without any I/O.
+Called without frame_lock, after UPAGE has been unmapped from T's page directory. */
 bool 
 page_to_disk (struct thread *t, void *upage, void* kpage)
 {
@@ -175,53 +360,34 @@ page_to_disk (struct thread *t, void *upage, void* kpage)
   ASSERT (pg_ofs (upage) == 0);  
   ASSERT (is_user_vaddr (upage));
 
-  ASSERT (pagedir_get_page(t -> pagedir, upage) != NULL);
-
   spte = lookup_page (spd, upage, false);
 
   if (spte != NULL) 
     {
       ASSERT (SPT_FLAG(spte -> o_pte) != PAG_INV);
-      if (SPT_FLAG(spte -> o_pte) != PAG_FILE)
+
+      if (page_needs_swap (t, upage))
       {
-        enum spd_flags flag = PAG_SWAP;
-        bool writable = SPT_WRITABLE(spte -> o_pte);
+        if (zswap_store (t, upage, kpage))
+          return true;
         int swap_slot = swap_into_disk(kpage);
-
-        spte-> o_pte = spte_create_user(swap_slot, flag, writable, 0); // IN_MEM bit is 0
+        if (swap_slot < 0)
+          return false;
+        page_set_swapped (t, upage, swap_slot);
+        return true;
       }
-      else if (pagedir_is_dirty(t -> pagedir, upage))
+      else if (SPT_SWAP_CACHED(spte -> o_pte))
       {
-        if (SPT_MMAPPED(spte -> o_pte))
-        {
-          mapid_t mid = spte -> o_pte & SECT_BITS;
-          struct file *mf = (t -> mmap_table[mid]).mfile;
-
-          lock_acquire(&filesys_lock);
-          
-          int write_size, flen = file_length(mf);
-          write_size = (flen - spte -> file_offt) > PGSIZE ? PGSIZE : (flen - spte -> file_offt);
-          file_seek(mf, spte -> file_offt);
-          int len_written = file_write(mf, upage, write_size);
-          
-          lock_release(&filesys_lock);
-          
-          if (len_written != PGSIZE)
-            return false;
-        }
-        else
-        {
-          /* Case where automatic variables were set as PAG_FILE by mistake while loading, need to correct */
-          enum spd_flags flag = PAG_SWAP;
-          bool writable = SPT_WRITABLE(spte -> o_pte);
-          int swap_slot = swap_into_disk(kpage);
-
-          spte-> o_pte = spte_create_user(swap_slot, flag, writable, 0); // IN_MEM bit is 0
-          spte -> file_offt = 0;
-
-        }
-          
+        /* The swap slot still holds this exact page: keep it. */
+        spte -> o_pte = set_swap_cache_bit (spte -> o_pte, false);
+      }
+      else if (SPT_MMAPPED(spte -> o_pte) && pagedir_is_dirty(t -> pagedir, upage))
+      {
+        if (!mmap_write (t, spte, kpage))
+          return false;
       }
+      /* Otherwise a clean zero or file page: it faults back in
+         from where it came. */
 
       spte -> o_pte = set_in_mem_bit (spte -> o_pte, false);
       //if (upage == (void *)0x805c000)
@@ -234,23 +400,265 @@ page_to_disk (struct thread *t, void *upage, void* kpage)
 }
 
 
-/* Looks up the physical address that corresponds to user virtual
-   address UADDR in PD.  Returns the kernel virtual address
-   corresponding to that physical address, or a null pointer if
-   UADDR is unmapped. */
-bool
-page_supp_chkmap (uint32_t *spd, const void *uaddr) 
+/* Returns the VMA of T that contains UADDR, or a null pointer if
+   there is none.  The last VMA found is tried first, since faults
+   tend to come in runs within one region.
+
+   A sorted list is enough here: a process has at most NO_FILE_MAX
+   mappings plus its segments and heap, so a miss on the hint
+   walks some 130 entries at worst and usually a handful, and a
+   balanced tree would only add rebalancing to every mmap and
+   munmap. */
+static struct vma *
+vma_find (struct thread *t, const void *uaddr)
 {
-  struct sup_pt_entry *spte;
+  struct list_elem *e;
+  struct vma *v = t -> vma_hint;
+
+  if (v != NULL && (uint8_t *) uaddr >= v -> start && (uint8_t *) uaddr < v -> end)
+    return v;
+
+  for (e = list_begin (&t -> vmas); e != list_end (&t -> vmas); e = list_next (e))
+    {
+      v = list_entry (e, struct vma, elem);
+      if ((uint8_t *) uaddr < v -> start)
+        break;
+      if ((uint8_t *) uaddr < v -> end)
+        {
+          t -> vma_hint = v;
+          return v;
+        }
+    }
+  return NULL;
+}
+
+/* Returns the supplemental page table entry for UADDR in SPD,
+   which must be the running process's.  If UADDR has no entry
+   yet but lies in a VMA, the entry is made from the VMA.
+   Returns a null pointer if UADDR is not mapped, or if memory
+   for the entry cannot be allocated. */
+static struct sup_pt_entry *
+spte_lookup (uint32_t *spd, const void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct sup_pt_entry *spte = lookup_page (spd, uaddr, false);
+  struct vma *v;
+  uint8_t *upage;
+  uint32_t ofs;
+
+  ASSERT (spd == t -> spd);
 
-  ASSERT (is_user_vaddr (uaddr));
-  
-  spte = lookup_page (spd, uaddr, false);
-  
   if (spte != NULL && SPT_FLAG(spte -> o_pte) != PAG_INV)
-    return true;
+    return spte;
+  v = vma_find (t, uaddr);
+  if (v == NULL)
+    return NULL;
+  spte = lookup_page (spd, uaddr, true);
+  if (spte == NULL)
+    return NULL;
+
+  upage = pg_round_down (uaddr);
+  ofs = upage - v -> start;
+  if (ofs >= v -> read_bytes)
+    spte -> o_pte = spte_create_user (0, PAG_ZERO, v -> writable, false);
+  else if (v -> mapid >= 0)
+    spte -> o_pte = spte_create_user (v -> mapid, PAG_FILE, v -> writable, true);
   else
+    {
+      uint32_t page_read_bytes = v -> read_bytes - ofs < PGSIZE ? v -> read_bytes - ofs : PGSIZE;
+      spte -> o_pte = spte_create_user (PGSIZE - page_read_bytes, PAG_FILE,
+                                        v -> writable, false);
+    }
+  spte -> file_offt = v -> file_ofs + ofs;
+  return spte;
+}
+
+/* Maps LENGTH bytes at page-aligned START in T's address space,
+   rounded up to whole pages.  The first READ_BYTES bytes come from
+   a file starting at offset FILE_OFS: from the mapping MAPID's
+   file if MAPID is nonnegative, otherwise from the executable.
+   The rest are zero.  No per-page work is done here; each page
+   gets its supplemental page table entry when first looked up.
+   Returns false if the range overlaps an existing VMA or memory
+   is short. */
+bool
+page_vma_add (struct thread *t, void *start, size_t length,
+              uint32_t file_ofs, uint32_t read_bytes, bool writable,
+              int mapid)
+{
+  struct list_elem *e;
+  struct vma *v;
+
+  ASSERT (pg_ofs (start) == 0);
+
+  if (length == 0 || page_vma_overlaps (t, start, length))
     return false;
+  v = malloc (sizeof *v);
+  if (v == NULL)
+    return false;
+  v -> start = start;
+  v -> end = (uint8_t *) start + ROUND_UP (length, PGSIZE);
+  v -> file_ofs = file_ofs;
+  v -> read_bytes = read_bytes;
+  v -> writable = writable;
+  v -> mapid = mapid;
+  v -> advice = MADV_NORMAL;
+
+  for (e = list_begin (&t -> vmas); e != list_end (&t -> vmas); e = list_next (e))
+    if (list_entry (e, struct vma, elem) -> start > v -> start)
+      break;
+  list_insert (e, &v -> elem);
+  return true;
+}
+
+/* Returns true if any of the LENGTH bytes at START falls in one of
+   T's VMAs. */
+bool
+page_vma_overlaps (struct thread *t, const void *start, size_t length)
+{
+  const uint8_t *end = (const uint8_t *) start + length;
+  struct list_elem *e;
+
+  for (e = list_begin (&t -> vmas); e != list_end (&t -> vmas); e = list_next (e))
+    {
+      struct vma *v = list_entry (e, struct vma, elem);
+      if (v -> start >= end)
+        break;
+      if (v -> end > (const uint8_t *) start)
+        return true;
+    }
+  return false;
+}
+
+/* Removes the VMA of T that starts at START.  Entries already made
+   from it are the caller's to clear. */
+void
+page_vma_remove (struct thread *t, void *start)
+{
+  struct vma *v = vma_find (t, start);
+
+  if (v == NULL)
+    return;
+  ASSERT (v -> start == start);
+  if (t -> vma_hint == v)
+    t -> vma_hint = NULL;
+  list_remove (&v -> elem);
+  free (v);
+}
+
+/* Returns the size in bytes of T's VMA that starts at START,
+   rounded up to whole pages, or 0 if there is none. */
+size_t
+page_vma_length (struct thread *t, const void *start)
+{
+  struct vma *v = vma_find (t, start);
+
+  if (v == NULL || v -> start != start)
+    return 0;
+  return v -> end - v -> start;
+}
+
+/* Returns the end of T's highest VMA, or a null pointer if T has
+   none. */
+void *
+page_vma_top (struct thread *t)
+{
+  if (list_empty (&t -> vmas))
+    return NULL;
+  return list_entry (list_back (&t -> vmas), struct vma, elem) -> end;
+}
+
+/* Returns the highest page-aligned address below STK_LIM_ADDR
+   where LENGTH bytes fit between T's VMAs and above its heap, or
+   a null pointer if there is no such room. */
+void *
+page_vma_find_gap (struct thread *t, size_t length)
+{
+  uint8_t *top = STK_LIM_ADDR;
+  uint8_t *floor = pg_round_up (t -> brk);
+  struct list_elem *e;
+
+  if (floor == NULL)
+    return NULL;
+  length = ROUND_UP (length, PGSIZE);
+  for (e = list_rbegin (&t -> vmas); e != list_rend (&t -> vmas);
+       e = list_prev (e))
+    {
+      struct vma *v = list_entry (e, struct vma, elem);
+
+      if (top < floor + length)
+        return NULL;
+      if (v -> end <= top - length)
+        break;
+      if (v -> start < top)
+        top = v -> start;
+    }
+  return top >= floor + length ? top - length : NULL;
+}
+
+/* Moves the end of T's heap to NEW_BRK, mapping zeroed pages as
+   it grows and freeing pages as it shrinks.  The heap is one VMA
+   from heap_start, made when it first takes a page.  Returns
+   false if the heap would run into another VMA or the stack. */
+bool
+page_heap_resize (struct thread *t, void *new_brk)
+{
+  uint8_t *old_end = pg_round_up (t -> brk);
+  uint8_t *new_end = pg_round_up (new_brk);
+  uint8_t *p;
+
+  ASSERT (t -> heap_start != NULL && (uint8_t *) new_brk >= t -> heap_start);
+
+  if (new_end > old_end)
+    {
+      if (new_end > (uint8_t *) STK_LIM_ADDR
+          || page_vma_overlaps (t, old_end, new_end - old_end))
+        return false;
+      if (old_end == t -> heap_start)
+        {
+          if (!page_vma_add (t, t -> heap_start, new_end - t -> heap_start,
+                             0, 0, true, -1))
+            return false;
+        }
+      else
+        vma_find (t, t -> heap_start) -> end = new_end;
+    }
+  else if (new_end < old_end)
+    {
+      pagedir_batch_begin ();
+      for (p = new_end; p < old_end; p += PGSIZE)
+        {
+          frame_free_page (t, p);
+          page_supp_clear_page (t -> spd, p);
+        }
+      pagedir_batch_end ();
+      if (new_end == t -> heap_start)
+        page_vma_remove (t, t -> heap_start);
+      else
+        vma_find (t, t -> heap_start) -> end = new_end;
+    }
+  t -> brk = new_brk;
+  return true;
+}
+
+/* Frees all of T's VMAs. */
+void
+page_vma_destroy (struct thread *t)
+{
+  while (!list_empty (&t -> vmas))
+    free (list_entry (list_pop_front (&t -> vmas), struct vma, elem));
+  t -> vma_hint = NULL;
+}
+
+/* Returns true if UADDR is mapped in SPD, the running process's
+   supplemental page directory, either by an entry of its own or
+   by a VMA. */
+bool
+page_supp_chkmap (uint32_t *spd, const void *uaddr) 
+{
+  ASSERT (is_user_vaddr (uaddr));
+  
+  return spte_lookup (spd, uaddr) != NULL;
 }
 
 void
@@ -267,64 +675,520 @@ page_supp_print (uint32_t *spd, const void *uaddr)
     printf("Invalid SPT entry for VA %x\n", uaddr);
 }
 
+/* Returns true if the page containing UADDR is marked resident
+   in SPD, including a page that is being evicted right now. */
+bool
+page_supp_in_mem (uint32_t *spd, const void *uaddr) 
+{
+  struct sup_pt_entry *spte = lookup_page (spd, uaddr, false);
+
+  return spte != NULL && SPT_FLAG(spte -> o_pte) != PAG_INV
+         && SPT_IN_MEM(spte -> o_pte);
+}
+
+/* Returns the file that backs file page SPTE of T, and stores in
+   *READ_BYTES how many bytes of the page come from it; the rest
+   of the page is zero. */
+static struct file *
+spte_file (struct thread *t, struct sup_pt_entry *spte, int *read_bytes)
+{
+  struct file *f;
+
+  if (SPT_MMAPPED(spte -> o_pte)) 
+    {
+      mapid_t mid  = spte -> o_pte & SECT_BITS;
+      int len;
+
+      f = (t -> mmap_table[mid]).mfile;
+      len = file_length(f);
+      *read_bytes = (len - (int) spte -> file_offt) > (PGSIZE) ? PGSIZE : len - (int) spte -> file_offt;
+    }
+  else
+    {
+      f = t -> exec_file;
+      *read_bytes = PGSIZE - (spte -> o_pte & SECT_BITS);
+    }
+  return f;
+}
+
+/* Returns true if SPTE is a read-only page of the executable,
+   which all processes running it can share. */
+static bool
+spte_shareable (struct sup_pt_entry *spte)
+{
+  return SPT_FLAG(spte -> o_pte) == PAG_FILE && !SPT_MMAPPED(spte -> o_pte)
+         && !SPT_WRITABLE(spte -> o_pte);
+}
+
+/* Maps read-only text page UPAGE of T, described by SPTE, to the
+   copy shared by all processes running the same executable,
+   reading it first if no process has it yet.  Returns false if
+   the page could not be shared, in which case the caller loads a
+   private copy as usual. */
+static bool
+page_share_in (struct thread *t, void *upage, struct sup_pt_entry *spte)
+{
+  disk_sector_t sector = inode_get_inumber (file_get_inode (t -> exec_file));
+  int read_bytes = PGSIZE - (spte -> o_pte & SECT_BITS);
+  void *kpage = frame_share_get (t, upage, sector, spte -> file_offt,
+                                 read_bytes);
+
+  if (kpage == NULL)
+    {
+      void *new_kpage = frame_get_page (PAL_USER);
+
+      lock_acquire(&filesys_lock);
+      file_read_at(t -> exec_file, new_kpage, read_bytes, spte -> file_offt);
+      lock_release(&filesys_lock);
+      memset (new_kpage + read_bytes, 0, PGSIZE - read_bytes);
+
+      kpage = frame_share_add (t, upage, sector, spte -> file_offt,
+                               read_bytes, new_kpage);
+      if (kpage == NULL)
+        {
+          palloc_free_page (new_kpage);
+          return false;
+        }
+      if (kpage != new_kpage)
+        palloc_free_page (new_kpage);
+    }
+
+  spte -> o_pte = set_in_mem_bit(spte->o_pte, 1);
+  pagedir_set_page(t -> pagedir, upage, kpage, false);
+  return true;
+}
+
+/* Returns the access advice given for user page UPAGE of T. */
+static int
+page_advice (struct thread *t, const void *upage)
+{
+  struct vma *v = vma_find (t, upage);
+
+  return v != NULL ? v -> advice : MADV_NORMAL;
+}
+
+/* Reads file page UPAGE of T, described by SPTE, into KPAGE.
+   Fault-around: the pages after UPAGE that continue the same
+   file at the following offsets are read by the same filesystem
+   call, up to FILE_FAULT_AROUND pages in all, and mapped as if
+   they had faulted in.  As with swap readahead, only frames that
+   are free right now are used, and the window ends at the first
+   page that does not qualify or is not read in full.  Under
+   MADV_SEQUENTIAL the window is FILE_FAULT_AROUND_SEQ pages;
+   under MADV_RANDOM there is none. */
+static void
+page_file_in (struct thread *t, uint32_t *spd, void *upage, void *kpage,
+              struct sup_pt_entry *spte)
+{
+  void *kpages[FILE_FAULT_AROUND_SEQ];
+  struct sup_pt_entry *sptes[FILE_FAULT_AROUND_SEQ];
+  int read_bytes[FILE_FAULT_AROUND_SEQ];
+  struct file *f = spte_file (t, spte, &read_bytes[0]);
+  int advice = page_advice (t, upage);
+  size_t window, cnt, i;
+
+  window = (advice == MADV_SEQUENTIAL ? FILE_FAULT_AROUND_SEQ
+            : advice == MADV_RANDOM ? 1 : FILE_FAULT_AROUND);
+  kpages[0] = kpage;
+  sptes[0] = spte;
+  for (cnt = 1; cnt < window && read_bytes[cnt - 1] == PGSIZE;
+       cnt++)
+    {
+      void *next = upage + cnt * PGSIZE;
+      struct sup_pt_entry *next_spte;
+
+      if (!is_user_vaddr (next))
+        break;
+      next_spte = spte_lookup (spd, next);
+      if (next_spte == NULL || SPT_FLAG(next_spte -> o_pte) != PAG_FILE
+          || SPT_IN_MEM(next_spte -> o_pte) || spte_shareable (next_spte)
+          || spte_file (t, next_spte, &read_bytes[cnt]) != f
+          || next_spte -> file_offt != spte -> file_offt + cnt * PGSIZE)
+        break;
+      kpages[cnt] = palloc_get_page (PAL_USER);
+      if (kpages[cnt] == NULL)
+        break;
+      sptes[cnt] = next_spte;
+    }
+
+  lock_acquire(&filesys_lock);
+  file_read_pages(f, kpages, cnt, spte -> file_offt);
+  lock_release(&filesys_lock);
+
+  for (i = 0; i < cnt; i++)
+    memset (kpages[i] + read_bytes[i], 0, PGSIZE - read_bytes[i]);
+
+  for (i = 1; i < cnt; i++)
+    {
+      void *next = upage + i * PGSIZE;
+
+      if (!pagedir_set_page (t -> pagedir, next, kpages[i],
+                             SPT_WRITABLE(sptes[i] -> o_pte)))
+        {
+          palloc_free_page (kpages[i]);
+          continue;
+        }
+      sptes[i] -> o_pte = set_in_mem_bit (sptes[i] -> o_pte, 1);
+      set_frame (t, next, kpages[i]);
+    }
+}
+
+/* Reads user page UPAGE of T, which is in swap slot SWAP_SLOT,
+   into KPAGE.  The pages after UPAGE that were swapped out to the
+   slots after SWAP_SLOT are read by the same disk command, up to
+   swap_readahead pages in all, and mapped as if they had faulted
+   in.  Readahead only takes frames that are free right now, and
+   stops at the first page that does not qualify; there is none
+   under MADV_RANDOM.  A page read
+   ahead but never touched has its accessed bit clear, so it is
+   among the first to be evicted again, and cheaply, as it keeps
+   its slot. */
+static void
+page_swap_in (struct thread *t, uint32_t *spd, void *upage, void *kpage,
+              int swap_slot)
+{
+  void *kpages[SWAP_READAHEAD_MAX];
+  struct sup_pt_entry *sptes[SWAP_READAHEAD_MAX];
+  size_t window, cnt, i;
+
+  window = page_advice (t, upage) == MADV_RANDOM ? 1 : swap_readahead;
+  kpages[0] = kpage;
+  for (cnt = 1; cnt < window; cnt++)
+    {
+      void *next = upage + cnt * PGSIZE;
+      struct sup_pt_entry *spte;
+
+      if (!is_user_vaddr (next))
+        break;
+      spte = lookup_page (spd, next, false);
+      if (spte == NULL || SPT_FLAG(spte -> o_pte) != PAG_SWAP
+          || SPT_IN_MEM(spte -> o_pte) || SPT_ZSWAPPED(spte -> o_pte)
+          || (spte -> o_pte & SECT_BITS) != (uint32_t) swap_slot + cnt)
+        break;
+      kpages[cnt] = palloc_get_page (PAL_USER);
+      if (kpages[cnt] == NULL)
+        break;
+      sptes[cnt] = spte;
+    }
+
+  swap_read_cluster (kpages, swap_slot, cnt);
+
+  for (i = 1; i < cnt; i++)
+    {
+      void *next = upage + i * PGSIZE;
+
+      if (!pagedir_set_page (t -> pagedir, next, kpages[i],
+                             SPT_WRITABLE(sptes[i] -> o_pte)))
+        {
+          palloc_free_page (kpages[i]);
+          continue;
+        }
+      sptes[i] -> o_pte = set_in_mem_bit (sptes[i] -> o_pte, 1);
+      sptes[i] -> o_pte = set_swap_cache_bit (sptes[i] -> o_pte, true);
+      set_frame (t, next, kpages[i]);
+    }
+}
+
+/* Returns true if the page containing UADDR is mapped to the
+   shared zero page. */
+bool
+page_zero_mapped (uint32_t *spd, const void *uaddr)
+{
+  struct sup_pt_entry *spte = lookup_page (spd, uaddr, false);
+
+  return spte != NULL && SPT_FLAG(spte -> o_pte) == PAG_ZERO
+         && SPT_ZERO_MAPPED(spte -> o_pte);
+}
+
+/* Handles the first write to the page containing UADDR, which is
+   mapped to the shared zero page: gives it a zeroed frame of its
+   own.  Returns false if the page is read-only. */
 bool
-page_to_memory (uint32_t *spd, const void *uaddr)
+page_zero_copy (uint32_t *spd, const void *uaddr)
+{
+  struct sup_pt_entry *spte = lookup_page (spd, uaddr, false);
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (uaddr);
+  void *kpage;
+
+  ASSERT (page_zero_mapped (spd, uaddr));
+  if (!SPT_WRITABLE(spte -> o_pte))
+    return false;
+
+  kpage = frame_get_page (PAL_USER | PAL_ZERO);
+  pagedir_clear_page (t -> pagedir, upage);
+  spte -> o_pte = set_zero_map_bit (spte -> o_pte, false);
+  pagedir_set_page (t -> pagedir, upage, kpage, true);
+  set_frame (t, upage, kpage);
+  return true;
+}
+
+/* Under MADV_SEQUENTIAL, the pages one fault-around window or
+   more behind UPAGE, which is faulting in, have most likely been
+   used up: makes the window before that the first candidates for
+   eviction, so that a scan does not push out other hot pages. */
+static void
+page_drop_behind (struct thread *t, uint8_t *upage)
+{
+  struct vma *v = vma_find (t, upage);
+  uint8_t *start, *end;
+
+  if (v == NULL || v -> advice != MADV_SEQUENTIAL
+      || upage - v -> start <= FILE_FAULT_AROUND_SEQ * PGSIZE)
+    return;
+  end = upage - FILE_FAULT_AROUND_SEQ * PGSIZE;
+  start = end - v -> start > FILE_FAULT_AROUND_SEQ * PGSIZE
+          ? end - FILE_FAULT_AROUND_SEQ * PGSIZE : v -> start;
+  frame_deactivate_range (t, start, end - start);
+}
+
+/* Applies ADVICE to the LENGTH bytes at page-aligned ADDR in T's
+   address space, all of which must be in VMAs.
+   MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are kept in each
+   VMA the range touches, whole, and steer fault-around, swap
+   readahead and drop-behind for its pages.  MADV_WILLNEED brings
+   the pages in now, as far as free frames go.  MADV_DONTNEED
+   drops them: they come back from their file, or zeroed, when
+   touched again.  Dirty mmap pages must have been written back
+   first.  Returns false if the range or the advice is bad. */
+bool
+page_madvise (struct thread *t, void *addr, size_t length, int advice)
+{
+  uint8_t *start = addr, *end, *p;
+  struct list_elem *e;
+
+  if (pg_ofs (addr) != 0 || length == 0
+      || length > (size_t) ((uint8_t *) PHYS_BASE - start))
+    return false;
+  end = start + ROUND_UP (length, PGSIZE);
+
+  /* Check that the VMAs cover the range without holes. */
+  p = start;
+  for (e = list_begin (&t -> vmas); e != list_end (&t -> vmas) && p < end;
+       e = list_next (e))
+    {
+      struct vma *v = list_entry (e, struct vma, elem);
+
+      if (v -> end <= p)
+        continue;
+      if (v -> start > p)
+        return false;
+      p = v -> end;
+    }
+  if (p < end)
+    return false;
+
+  switch (advice)
+    {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+      for (e = list_begin (&t -> vmas); e != list_end (&t -> vmas);
+           e = list_next (e))
+        {
+          struct vma *v = list_entry (e, struct vma, elem);
+
+          if (v -> start < end && v -> end > start)
+            v -> advice = advice;
+        }
+      break;
+
+    case MADV_WILLNEED:
+      for (p = start; p < end && palloc_user_free_cnt () > 0; p += PGSIZE)
+        if (page_supp_chkmap (t -> spd, p) && !page_supp_in_mem (t -> spd, p))
+          page_to_memory (t -> spd, p, false);
+      break;
+
+    case MADV_DONTNEED:
+      pagedir_batch_begin ();
+      for (p = start; p < end; p += PGSIZE)
+        {
+          frame_free_page (t, p);
+          page_supp_clear_page (t -> spd, p);
+        }
+      pagedir_batch_end ();
+      break;
+
+    default:
+      return false;
+    }
+  return true;
+}
+
+/* Grows T's stack down to FAULT_ADDR, a valid stack access that
+   faulted below the stack, and brings its page in.  WRITE is as
+   for page_to_memory().
+   Growth adapts: a fault on the page right below the stack means
+   the stack is being walked down a page at a time, so each such
+   fault maps twice as many pages below FAULT_ADDR as the last,
+   up to STK_GROW_MAX, and faults them in while free frames last.
+   Any other fault starts over at one page.  Pages between
+   FAULT_ADDR and the old bottom of the stack, as left by a large
+   frame, are mapped too, to fault in when touched.  Nothing is
+   mapped below STK_LIM_ADDR.  Returns false if out of memory. */
+bool
+page_stack_grow (struct thread *t, void *fault_addr, bool write)
+{
+  uint8_t *upage = pg_round_down (fault_addr);
+  uint8_t *top = upage + PGSIZE > t -> stack_low ? upage + PGSIZE : t -> stack_low;
+  uint8_t *low, *p;
+
+  if (upage + PGSIZE == t -> stack_low)
+    t -> stack_grow = t -> stack_grow * 2 < STK_GROW_MAX
+                      ? t -> stack_grow * 2 : STK_GROW_MAX;
+  else
+    t -> stack_grow = 1;
+
+  low = upage;
+  while ((size_t) (upage - low) / PGSIZE + 1 < t -> stack_grow
+         && low - PGSIZE >= (uint8_t *) STK_LIM_ADDR)
+    low -= PGSIZE;
+
+  for (p = low; p < top; p += PGSIZE)
+    if (!page_supp_chkmap (t -> spd, p)
+        && !page_supp_set (t -> spd, p, 0, PAG_ZERO, 0, true, true))
+      return false;
+  if (low < t -> stack_low)
+    t -> stack_low = low;
+
+  if (!page_to_memory (t -> spd, fault_addr, write))
+    return false;
+  for (p = upage - PGSIZE; p >= low && palloc_user_free_cnt () > 0; p -= PGSIZE)
+    if (!page_supp_in_mem (t -> spd, p))
+      page_to_memory (t -> spd, p, true);
+  return true;
+}
+
+/* Maps the whole 4 MB-aligned block around UPAGE, T's, with one
+   4 MB page of zeros, if the block lies within a writable VMA
+   with no file data and none of its pages has been touched yet.
+   Returns false, having changed nothing visible, if the block
+   does not qualify or the user pool has no aligned 4 MB run
+   free; UPAGE then faults in as a 4 kB page. */
+static bool
+page_large_in (struct thread *t, uint32_t *spd, uint8_t *upage)
+{
+  uint8_t *base = (uint8_t *) ((uintptr_t) upage & ~(PTSPAN - 1));
+  struct vma *v = vma_find (t, upage);
+  void *kpage;
+  uint8_t *p;
+
+  if (v == NULL || v -> read_bytes != 0 || !v -> writable
+      || base < v -> start || base + PTSPAN > v -> end)
+    return false;
+
+  /* UPAGE itself was just looked up, so it has a PAG_ZERO entry;
+     so may others that were never brought in. */
+  for (p = base; p < base + PTSPAN; p += PGSIZE)
+    {
+      struct sup_pt_entry *spte = lookup_page (spd, p, false);
+
+      if (spte != NULL && SPT_FLAG(spte -> o_pte) != PAG_INV
+          && (SPT_FLAG(spte -> o_pte) != PAG_ZERO || SPT_IN_MEM(spte -> o_pte)))
+        return false;
+    }
+  for (p = base; p < base + PTSPAN; p += PGSIZE)
+    if (spte_lookup (spd, p) == NULL)
+      return false;
+
+  kpage = palloc_get_large (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_large (t -> pagedir, base, kpage, true))
+    {
+      palloc_free_multiple (kpage, 1 << PTBITS);
+      return false;
+    }
+  for (p = base; p < base + PTSPAN; p += PGSIZE)
+    {
+      struct sup_pt_entry *spte = lookup_page (spd, p, false);
+      spte -> o_pte = set_in_mem_bit (spte -> o_pte, 1);
+    }
+  frame_set_large (t, base, kpage);
+  return true;
+}
+
+/* Brings the page containing UADDR into memory.  WRITE is true if
+   the faulting access was a write; a PAG_ZERO page read first is
+   mapped to the shared zero page, without a frame, until it is
+   written.  Returns false if UADDR is not mapped or its page
+   table cannot be allocated. */
+bool
+page_to_memory (uint32_t *spd, const void *uaddr, bool write)
 {
   struct sup_pt_entry *spte; 
-  ASSERT (page_supp_chkmap(spd, uaddr));
+
+  /* Also makes the entry from the VMA if it has none yet. */
+  if (!page_supp_chkmap (spd, uaddr))
+    return false;
+
+  /* The page may be on its way out; let that finish first. */
+  frame_wait_evicted (thread_current (), pg_round_down (uaddr));
 
 
   spte = lookup_page (spd, uaddr, false);
   ASSERT (SPT_IN_MEM(spte -> o_pte) == 0);
 
   void *upage = pg_round_down(uaddr);
+  struct thread* t= thread_current();
+
+  if (spte_shareable (spte) && page_share_in (t, upage, spte))
+    return true;
+
+  if (page_large && SPT_FLAG(spte -> o_pte) == PAG_ZERO
+      && page_large_in (t, spd, upage))
+    return true;
+
+  if (SPT_FLAG(spte -> o_pte) == PAG_ZERO && !write)
+    {
+      if (!pagedir_set_page (t -> pagedir, upage, zero_page, false))
+        return false;
+      spte -> o_pte = set_in_mem_bit (spte -> o_pte, 1);
+      spte -> o_pte = set_zero_map_bit (spte -> o_pte, true);
+      return true;
+    }
+
   void *kpage = frame_get_page(PAL_USER);
   int flag = SPT_FLAG(spte -> o_pte);
-  struct thread* t= thread_current();
   bool writable = SPT_WRITABLE(spte -> o_pte);
 
+  /* Map the frame before filling it: a swap-in may consume the
+     page's only other copy, so failing afterwards would lose it.
+     The process is blocked here, so it cannot see the frame
+     early, and the frame is not in the frame table yet. */
+  if (!pagedir_set_page (t -> pagedir, upage, kpage, writable))
+    {
+      palloc_free_page (kpage);
+      return false;
+    }
+
   if (flag == PAG_ZERO) {
     memset(kpage, 0, PGSIZE);
   }
 
   else if (flag == PAG_SWAP) {
-    int swap_slot = spte -> o_pte & SECT_BITS; 
-    swap_into_memory(kpage, swap_slot);
+    if (SPT_ZSWAPPED(spte -> o_pte) && zswap_load (t, upage, kpage))
+      /* The compressed copy is gone: the page lives only here now. */
+      spte -> o_pte = set_zswap_bit (spte -> o_pte, false);
+    else {
+      /* On disk, possibly written back from compressed swap just now. */
+      int swap_slot = spte -> o_pte & SECT_BITS; 
+      page_swap_in(t, spd, upage, kpage, swap_slot);
+      /* Keep the slot until the page is dirtied (see page_to_disk). */
+      spte -> o_pte = set_swap_cache_bit (spte -> o_pte, true);
+    }
   }
 
   else if (flag == PAG_FILE) {
-    struct file *ef;
-    int page_read_bytes;
-    if (SPT_MMAPPED(spte -> o_pte)) 
-    {
-      mapid_t mid  = spte -> o_pte & SECT_BITS;
-      ef = (t -> mmap_table[mid]).mfile;
-      int len = file_length(ef);
-      page_read_bytes = (len - spte -> file_offt) > (PGSIZE) ? PGSIZE : len - spte -> file_offt;
-    }
-    else
-    {
-      ef = thread_current() -> exec_file;
-      page_read_bytes = PGSIZE - (spte -> o_pte & SECT_BITS);
-    }
-
-    lock_acquire(&filesys_lock);
-
-    file_seek(ef, 0);    
-    file_read_at(ef, kpage, page_read_bytes, spte -> file_offt);
-    
-    lock_release(&filesys_lock);
-
-    memset (kpage + page_read_bytes, 0, PGSIZE - page_read_bytes);
-
+    page_file_in(t, spd, upage, kpage, spte);
   }
 
   spte -> o_pte = set_in_mem_bit(spte->o_pte, 1);  // setting the in_MEM bit
   // if (upage == (void *)0x805c000)
   // printf("PSm upage: %p, o_pte: %x, offt:%d\n", upage, spte -> o_pte, spte -> file_offt);
 
-  pagedir_set_page(thread_current() -> pagedir, upage, kpage, writable);
   set_frame (thread_current(), upage, kpage);
+  page_drop_behind (t, upage);
 
   return true;
 }
@@ -346,6 +1210,10 @@ page_supp_clear_page (uint32_t *spd, void *upage)
   spte = lookup_page (spd, upage, false);
   if (spte != NULL && SPT_FLAG(spte -> o_pte) != PAG_INV)
     {
+      if (SPT_ZSWAPPED(spte -> o_pte))
+        zswap_free (thread_current (), upage);
+      if (spte_owns_slot (spte -> o_pte))
+        swap_free (spte -> o_pte & SECT_BITS);
       spte -> o_pte = 0;
     }
 }
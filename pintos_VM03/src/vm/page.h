@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <list.h>
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 
@@ -10,14 +11,26 @@
 #define WRIT_BIT 29
 #define MMAP_BIT 27
 #define IN_MEM_BIT 28
+#define SWAP_CACHE_BIT 26	/* Resident PAG_SWAP page still owns its slot. */
+#define ZERO_MAP_BIT 25		/* PAG_ZERO page mapped to the shared zero page. */
+#define ZSWAP_BIT 24		/* PAG_SWAP page is in compressed swap. */
 
 #define SPT_MMAPPED(x) (((x) >> MMAP_BIT) & 1) 
 #define SPT_FLAG(x) ((x) >> SPT_FLAG_BITS)
 #define SPT_WRITABLE(x) (((x) >> WRIT_BIT) & 1)
 #define SPT_IN_MEM(x) (((x) >> IN_MEM_BIT) & 1)
+#define SPT_SWAP_CACHED(x) (((x) >> SWAP_CACHE_BIT) & 1)
+#define SPT_ZERO_MAPPED(x) (((x) >> ZERO_MAP_BIT) & 1)
+#define SPT_ZSWAPPED(x) (((x) >> ZSWAP_BIT) & 1)
+
+#define FILE_FAULT_AROUND 8		/* File pages read per fault, at most. */
+#define FILE_FAULT_AROUND_SEQ 16	/* Same, under MADV_SEQUENTIAL. */
 
 #define STK_LIM_SIZE (8 * 1024 * 1024)		/* stack size limit in bytes */
 #define STK_LIM_ADDR (void *)(PHYS_BASE - STK_LIM_SIZE)
+#define STK_GROW_MAX 16				/* Most stack pages mapped per growth. */
+
+extern bool page_large;
 
 
 
@@ -29,14 +42,51 @@ enum spd_flags
     PAG_FILE = 003           /* Page on filesys. */
   };
 
+/* A range of a process's address space backed by a file, or by
+   zeros past the file data.  Its pages have no supplemental page
+   table entries until first looked up; see page_vma_add(). */
+struct vma
+  {
+    struct list_elem elem;      /* In the thread's vmas, by START. */
+    uint8_t *start;             /* First page. */
+    uint8_t *end;               /* Past the last page. */
+    uint32_t file_ofs;          /* File offset of START. */
+    uint32_t read_bytes;        /* Bytes from the file; the rest is zero. */
+    bool writable;
+    int mapid;                  /* Mapping, or -1 for the executable. */
+    int advice;                 /* MADV_NORMAL, _RANDOM or _SEQUENTIAL. */
+  };
+
 uint32_t * page_supp_create (void);
-void page_supp_destroy (uint32_t *spd);
+void page_zero_init (void);
+void page_supp_destroy (uint32_t *spd, uint32_t *pd);
 bool page_supp_set_addr (uint32_t *spd, void *vaddr, int aux, 
                 		enum spd_flags flags, int file_offt, bool writable, bool mmap);
 bool page_supp_set (uint32_t *spd, void *upage, int aux, 
 					enum spd_flags flags, int file_offt, bool writable, bool mmap);
+bool page_vma_add (struct thread *t, void *start, size_t length,
+                   uint32_t file_ofs, uint32_t read_bytes, bool writable,
+                   int mapid);
+bool page_vma_overlaps (struct thread *t, const void *start, size_t length);
+void page_vma_remove (struct thread *t, void *start);
+size_t page_vma_length (struct thread *t, const void *start);
+void page_vma_destroy (struct thread *t);
+void *page_vma_top (struct thread *t);
+void *page_vma_find_gap (struct thread *t, size_t length);
+bool page_heap_resize (struct thread *t, void *new_brk);
+bool page_madvise (struct thread *t, void *addr, size_t length, int advice);
+bool page_stack_grow (struct thread *t, void *fault_addr, bool write);
 bool page_supp_chkmap (uint32_t *spd, const void *uaddr); 
+bool page_supp_in_mem (uint32_t *spd, const void *uaddr);
 void page_supp_print (uint32_t *spd, const void *uaddr); 
-bool page_to_memory (uint32_t *spd, const void *uaddr);
+bool page_to_memory (uint32_t *spd, const void *uaddr, bool write);
+bool page_zero_mapped (uint32_t *spd, const void *uaddr);
+bool page_zero_copy (uint32_t *spd, const void *uaddr);
 void page_supp_clear_page (uint32_t *spd, void *upage);
 bool page_to_disk (struct thread *t, void *upage, void* kpage);
+bool page_needs_swap (struct thread *t, void *upage);
+bool page_is_mmapped (struct thread *t, void *upage);
+bool page_write_back (struct thread *t, void *upage, void *kpage);
+void page_set_swapped (struct thread *t, void *upage, int swap_slot);
+void page_set_zswapped (struct thread *t, void *upage, int handle);
+int page_zswap_handle (struct thread *t, void *upage);
@@ -1,60 +1,304 @@
 #include "swap.h"
 #include "devices/disk.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
-#include <bitmap.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <round.h>
+#include <debug.h>
 
-static struct bitmap *swap_table;            /* Bitmap of free swap slots. */
-static struct disk* swap_disk;
-static struct lock swap_lock;
+/* Swap slot allocation map, one per swap device.  Bit I of
+   slot_map[W] is set if slot W * MAP_BITS + I is in use, and bit
+   J of full_map[S] is set if slot_map[S * MAP_BITS + J] has no
+   free slot.  Allocation is next-fit: it resumes at the word
+   where the last one ended, and skips full words 32 at a time
+   through full_map, so it does not rescan the busy start of the
+   disk on every eviction. */
+typedef uint32_t map_word;
+#define MAP_BITS 32
+#define MAP_FULL ((map_word) -1)
+
+/* A swap device.  Each has its own lock, so that allocating slots
+   on one device does not wait for another.  The disks themselves
+   may still share a channel: hd0 holds the kernel and the file
+   system, so all swap disks sit on channel 1 and their transfers
+   take turns under its lock. */
+struct swap_dev {
+	struct disk *disk;
+	map_word *slot_map;
+	map_word *full_map;
+	size_t map_words;		/* Words in slot_map. */
+	size_t next_word;		/* Where the next search starts. */
+	struct lock lock;		/* Guards the maps. */
+};
+
+/* Swap slot numbers hold the device index above SWAP_DEV_SHIFT and
+   the slot within the device below it. */
+#define SLOT_DEV(SLOT) ((SLOT) >> SWAP_DEV_SHIFT)
+#define SLOT_OFS(SLOT) ((SLOT) & ((1 << SWAP_DEV_SHIFT) - 1))
+
+static struct swap_dev swap_devs[SWAP_DEV_MAX];
+static size_t swap_dev_cnt;
+static size_t next_dev;			/* Device tried first next time. */
+
+/* Disks to swap on, as channel and device numbers, set with
+   -swap.  The default is hd1:1. */
+static int swap_disks[SWAP_DEV_MAX][2] = {{1, 1}};
+static size_t swap_disk_cnt = 1;
+
+/* Pages a swap fault reads in, counting the faulting page.
+   1 turns readahead off.  Set with -swapra. */
+size_t swap_readahead = 8;
+
+/* Sets the disks to swap on from LIST, a comma-separated list of
+   CHAN:DEV pairs such as "1:1,1:0".  Slots are striped across the
+   disks in list order, which adds capacity but, with both disks
+   on channel 1, not parallel transfers.  Returns false if LIST is malformed,
+   names a disk twice, or names hd0:0 or hd0:1, which hold the
+   kernel and the file system.  Whether the disks exist is only
+   known once they are probed, in swap_table_init(). */
+bool
+swap_set_disks (const char *list)
+{
+	size_t cnt = 0, i;
+	const char *p = list;
+
+	for (;;)
+	{
+		if (cnt == SWAP_DEV_MAX || p[0] < '0' || p[0] > '1' || p[1] != ':'
+		    || p[2] < '0' || p[2] > '1' || p[0] == '0')
+			return false;
+		swap_disks[cnt][0] = p[0] - '0';
+		swap_disks[cnt][1] = p[2] - '0';
+		for (i = 0; i < cnt; i++)
+			if (swap_disks[i][0] == swap_disks[cnt][0]
+			    && swap_disks[i][1] == swap_disks[cnt][1])
+				return false;
+		cnt++;
+		p += 3;
+		if (*p == '\0')
+			break;
+		if (*p++ != ',')
+			return false;
+	}
+	swap_disk_cnt = cnt;
+	return true;
+}
+
+/* Sets up swap device D on disk DISK. */
+static void
+swap_dev_init (struct swap_dev *d, struct disk *disk)
+{
+	size_t count = disk_size(disk) * SECT_TO_SLOT;  // number of swap slots
+	size_t full_words, map_pages, i;
+
+	/* Keep clear of the next device's slot numbers, even for a
+	   readahead run off the end of this one. */
+	if (count > (1 << SWAP_DEV_SHIFT) - SWAP_READAHEAD_MAX)
+		count = (1 << SWAP_DEV_SHIFT) - SWAP_READAHEAD_MAX;
+
+	d -> disk = disk;
+	d -> map_words = DIV_ROUND_UP (count, MAP_BITS);
+	full_words = DIV_ROUND_UP (d -> map_words, MAP_BITS);
+	map_pages = DIV_ROUND_UP ((d -> map_words + full_words) * sizeof (map_word), PGSIZE);
+	d -> slot_map = palloc_get_multiple (PAL_ZERO, map_pages);
+	if (d -> slot_map == NULL)
+		PANIC ("swap_table_init: out of memory");
+	d -> full_map = d -> slot_map + d -> map_words;
+	d -> next_word = 0;
+
+	/* Slots past the end of the disk are never free. */
+	for (i = count; i < d -> map_words * MAP_BITS; i++)
+		d -> slot_map[i / MAP_BITS] |= (map_word) 1 << (i % MAP_BITS);
+	for (i = 0; i < d -> map_words; i++)
+		if (d -> slot_map[i] == MAP_FULL)
+			d -> full_map[i / MAP_BITS] |= (map_word) 1 << (i % MAP_BITS);
+	for (i = d -> map_words; i < full_words * MAP_BITS; i++)
+		d -> full_map[i / MAP_BITS] |= (map_word) 1 << (i % MAP_BITS);
+
+	lock_init(&d -> lock);
+}
 
 void
 swap_table_init(void)
 {
-	swap_disk = disk_get(1,1);   /* disk corresponding to swap */
-	int count = disk_size(swap_disk) * SECT_TO_SLOT;  // number of swap slots
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (count), PGSIZE);
+	size_t i;
 
-	void *base = palloc_get_multiple(bm_pages);
-	swap_table = bitmap_create_in_buf(count, base, bm_pages*PGSIZE );
-	lock_init(&swap_lock);
+	for (i = 0; i < swap_disk_cnt; i++)
+	{
+		struct disk *disk = disk_get (swap_disks[i][0], swap_disks[i][1]);
+		if (disk == NULL)
+			PANIC ("-swap: swap disk hd%d:%d not present",
+			       swap_disks[i][0], swap_disks[i][1]);
+		swap_dev_init (&swap_devs[i], disk);
+	}
+	swap_dev_cnt = swap_disk_cnt;
 }
 
+/* Marks word W of D's slot_map full or not in its full_map. */
+static void
+update_full (struct swap_dev *d, size_t w)
+{
+	map_word bit = (map_word) 1 << (w % MAP_BITS);
+
+	if (d -> slot_map[w] == MAP_FULL)
+		d -> full_map[w / MAP_BITS] |= bit;
+	else
+		d -> full_map[w / MAP_BITS] &= ~bit;
+}
+
+/* Returns the index of the first slot of a run of CNT free slots
+   that starts in word W of D's slot_map, or -1 if there is none.
+   The run may continue into the next word. */
+static int
+find_run (struct swap_dev *d, size_t w, size_t cnt)
+{
+	map_word free_lo = ~d -> slot_map[w];
+	map_word free_hi = w + 1 < d -> map_words ? ~d -> slot_map[w + 1] : 0;
+	map_word starts = free_lo;
+	size_t k;
+
+	/* Bit I of STARTS survives if slots I..I+K are all free. */
+	for (k = 1; k < cnt && starts != 0; k++)
+		starts &= (free_lo >> k) | (free_hi << (MAP_BITS - k));
+	if (starts == 0)
+		return -1;
+	return w * MAP_BITS + __builtin_ctz (starts);
+}
+
+/* Allocates CNT consecutive free slots of D, CNT at most
+   MAP_BITS, and returns the first, or -1 if there is no such run.
+   Searches once around the disk from next_word, skipping full
+   words.  D's lock must be held. */
+static int
+alloc_slots (struct swap_dev *d, size_t cnt)
+{
+	size_t n, i;
+
+	ASSERT (cnt > 0 && cnt <= MAP_BITS);
+
+	for (n = 0; n < d -> map_words; n++)
+	{
+		size_t w = (d -> next_word + n) % d -> map_words;
+		int slot;
+
+		/* A full word of full_map means up to 32 full words in a
+		   row, the last group stopping at the end of slot_map:
+		   jump over them. */
+		if (w % MAP_BITS == 0 && d -> full_map[w / MAP_BITS] == MAP_FULL)
+		{
+			n += (d -> map_words - w < MAP_BITS ? d -> map_words - w : MAP_BITS) - 1;
+			continue;
+		}
+		if (d -> full_map[w / MAP_BITS] & ((map_word) 1 << (w % MAP_BITS)))
+			continue;
+
+		slot = find_run (d, w, cnt);
+		if (slot < 0)
+			continue;
+
+		for (i = slot; i < slot + cnt; i++)
+			d -> slot_map[i / MAP_BITS] |= (map_word) 1 << (i % MAP_BITS);
+		update_full (d, slot / MAP_BITS);
+		update_full (d, (slot + cnt - 1) / MAP_BITS);
+		d -> next_word = (slot + cnt - 1) / MAP_BITS;
+		return slot;
+	}
+	return -1;
+}
+
+/* Reads swap slot SWAP_SLOT_NUM into KPAGE.  The slot stays
+   allocated, so that a clean page can be evicted again without
+   being rewritten; release it with swap_free(). */
 void
 swap_into_memory (void *kpage, int swap_slot_num)
 {
-	int i, start_slot = swap_slot_num * SLOT_TO_SECT;
-	lock_acquire(&swap_lock);
-	for(i=0; i< SLOT_TO_SECT; i++)
+	swap_read_cluster (&kpage, swap_slot_num, 1);
+}
+
+/* Reads the CNT consecutive swap slots starting at SWAP_SLOT_NUM
+   into the pages in KPAGES, with one multi-sector disk read per
+   slot.  The slots must be on one device.  As with
+   swap_into_memory(), the slots stay allocated.  CNT may be at
+   most SWAP_READAHEAD_MAX. */
+void
+swap_read_cluster (void *kpages[], int swap_slot_num, size_t cnt)
+{
+	struct disk *disk = swap_devs[SLOT_DEV(swap_slot_num)].disk;
+	disk_sector_t sector = SLOT_OFS(swap_slot_num) * (SLOT_TO_SECT);
+	void *sectors[SLOT_TO_SECT];
+	size_t i, j;
+
+	ASSERT (cnt > 0 && cnt <= SWAP_READAHEAD_MAX);
+
+	/* A slot at a time keeps the sector list small enough for the
+	   kernel stack. */
+	for (i = 0; i < cnt; i++, sector += SLOT_TO_SECT)
 	{
-		disk_read (swap_disk, start_slot + i, kpage + i*(DISK_SECTOR_SIZE));	
+		for (j = 0; j < SLOT_TO_SECT; j++)
+			sectors[j] = (uint8_t *) kpages[i] + j * DISK_SECTOR_SIZE;
+		disk_read_multiple (disk, sector, sectors, SLOT_TO_SECT);
 	}
-	bitmap_reset (swap_table, swap_slot_num); 
-	lock_release(&swap_lock);
 }
 
+/* Writes KPAGE to a free swap slot and returns the slot number,
+   or -1 if swap is full. */
 int
 swap_into_disk (void *kpage)
 {
-	lock_acquire(&swap_lock);
-	int swap_slot_num = bitmap_scan_and_flip (swap_table, 0, 1, false);
-	int i, start_slot = swap_slot_num * SLOT_TO_SECT;
+	return swap_write_cluster (&kpage, 1);
+}
 
-	for(i=0; i< SLOT_TO_SECT; i++)
+/* Writes the CNT pages in KPAGES to CNT consecutive swap slots,
+   with one multi-sector disk write per slot, and returns the first
+   slot, or -1 if swap has no run of CNT free slots.  CNT may be
+   at most SWAP_CLUSTER.  Successive calls start on successive
+   devices, so that swap traffic is striped across them. */
+int
+swap_write_cluster (void *kpages[], size_t cnt)
+{
+	const void *sectors[SLOT_TO_SECT];
+	struct swap_dev *d = NULL;
+	size_t first = next_dev, i, j;
+	int slot = -1;
+
+	ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+	/* NEXT_DEV is only a hint, so it is read and advanced without
+	   a lock. */
+	next_dev = (first + 1) % swap_dev_cnt;
+	for (i = 0; i < swap_dev_cnt && slot < 0; i++)
+	{
+		d = &swap_devs[(first + i) % swap_dev_cnt];
+		lock_acquire(&d -> lock);
+		slot = alloc_slots (d, cnt);
+		lock_release(&d -> lock);
+	}
+	if (slot < 0)
+		return -1;
+
+	/* The slots are ours now, so no lock is needed to fill them. */
+	for (i = 0; i < cnt; i++)
 	{
-		disk_write (swap_disk, start_slot + i, kpage + i*(DISK_SECTOR_SIZE));	
+		for (j = 0; j < SLOT_TO_SECT; j++)
+			sectors[j] = (uint8_t *) kpages[i] + j * DISK_SECTOR_SIZE;
+		disk_write_multiple (d -> disk, (slot + i) * (SLOT_TO_SECT),
+				     sectors, SLOT_TO_SECT);
 	}
-	lock_release(&swap_lock);
 
-	return swap_slot_num;
+	return ((d - swap_devs) << SWAP_DEV_SHIFT) | slot;
 }
 
 void
 swap_free (int swap_slot_num)
 {
-	lock_acquire(&swap_lock);
-	bitmap_reset (swap_table, swap_slot_num); 
-	lock_release(&swap_lock);
+	struct swap_dev *d = &swap_devs[SLOT_DEV(swap_slot_num)];
+	int slot = SLOT_OFS(swap_slot_num);
+
+	lock_acquire(&d -> lock);
+	ASSERT (d -> slot_map[slot / MAP_BITS] & ((map_word) 1 << (slot % MAP_BITS)));
+	d -> slot_map[slot / MAP_BITS] &= ~((map_word) 1 << (slot % MAP_BITS));
+	update_full (d, slot / MAP_BITS);
+	lock_release(&d -> lock);
 	return;
 }
@@ -3,6 +3,24 @@
 #define SECT_TO_SLOT DISK_SECTOR_SIZE / PGSIZE
 #define SLOT_TO_SECT PGSIZE / DISK_SECTOR_SIZE
 
+/* Most swap devices, and where the device index starts in a swap
+   slot number.  Slot numbers must fit in SECT_BITS. */
+#define SWAP_DEV_MAX 4
+#define SWAP_DEV_SHIFT 18
+
+/* Most pages written to swap by one disk command. */
+#define SWAP_CLUSTER 8
+
+/* Most pages read from swap by one fault, the faulting page
+   included. */
+#define SWAP_READAHEAD_MAX 16
+
+extern size_t swap_readahead;
+
+bool swap_set_disks (const char *list);
 void swap_table_init(void);
 void swap_into_memory (void *kpage, int swap_slot_num);
-int swap_into_disk (void *kpage);
\ No newline at end of file
+int swap_into_disk (void *kpage);
+void swap_read_cluster (void *kpages[], int swap_slot_num, size_t cnt);
+int swap_write_cluster (void *kpages[], size_t cnt);
+void swap_free (int swap_slot_num);
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include "zswap.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "page.h"
+
+/* Compressed swap: evicted pages are compressed into a ring arena
+   in the kernel pool instead of being written to the swap disk.
+   When the arena is full, the oldest records are decompressed and
+   written to swap slots to make room.  Each record names its
+   owner, so that the owner's supplemental page table can be
+   pointed at the slot. */
+
+/* A page that does not compress below this size goes straight to
+   disk. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Records start on multiples of this, so that the gap left at the
+   end of the arena always has room for a header. */
+#define ZSWAP_ALIGN 16
+
+/* Compressor: size of the match finder's hash table, and the
+   shortest and longest match it encodes. */
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15 + 255)
+
+/* Header of a record in the arena.  The compressed page
+   follows. */
+struct zswap_entry
+{
+	struct thread *t;	/* Owner, NULL if the record is free. */
+	void *upage;		/* Owner's page. */
+	uint32_t span;		/* Bytes taken in the arena, header included. */
+	uint16_t size;		/* Bytes of compressed data. */
+};
+
+/* Size of the arena in pages, set by -zswap.  0 turns compressed
+   swap off. */
+size_t zswap_pages = ZSWAP_DEFAULT_PAGES;
+
+static uint8_t *arena;		/* Ring of records. */
+static size_t arena_size;	/* In bytes, 0 if compressed swap is off. */
+static size_t head;		/* Offset of the next record. */
+static size_t tail;		/* Offset of the oldest record. */
+static size_t used;		/* Bytes from TAIL up to HEAD. */
+static struct lock zswap_lock;
+
+static uint8_t *zbuf;		/* Compressor output. */
+static uint8_t *bounce;		/* Page being written back to disk. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];	/* Position + 1 by hash. */
+
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t max);
+static void lz_decompress (const uint8_t *src, size_t size, uint8_t *dst);
+
+void
+zswap_init (void)
+{
+	lock_init (&zswap_lock);
+	if (zswap_pages == 0)
+		return;
+
+	arena = palloc_get_multiple (0, zswap_pages);
+	zbuf = palloc_get_page (0);
+	bounce = palloc_get_page (0);
+	if (arena == NULL || zbuf == NULL || bounce == NULL)
+	{
+		printf ("zswap: out of memory, compressed swap disabled\n");
+		if (arena != NULL)
+			palloc_free_multiple (arena, zswap_pages);
+		palloc_free_page (zbuf);
+		palloc_free_page (bounce);
+		return;
+	}
+	arena_size = zswap_pages * PGSIZE;
+}
+
+static struct zswap_entry *
+entry_at (size_t ofs)
+{
+	return (struct zswap_entry *) (arena + ofs);
+}
+
+/* Retires the oldest record.  A live one is written to a swap
+   slot first, and its owner's page table updated.  Returns false
+   if swap is full. */
+static bool
+retire_oldest (void)
+{
+	struct zswap_entry *e = entry_at (tail);
+
+	if (e -> t != NULL)
+	{
+		int swap_slot;
+
+		lz_decompress ((uint8_t *) (e + 1), e -> size, bounce);
+		swap_slot = swap_into_disk (bounce);
+		if (swap_slot < 0)
+			return false;
+		page_set_swapped (e -> t, e -> upage, swap_slot);
+		e -> t = NULL;
+	}
+	used -= e -> span;
+	tail += e -> span;
+	if (tail == arena_size)
+		tail = 0;
+	return true;
+}
+
+/* Retires records, oldest first, until SPAN contiguous bytes are
+   free at HEAD.  Returns false if swap is full. */
+static bool
+make_room (size_t span)
+{
+	for (;;)
+	{
+		if (used == 0)
+			head = tail = 0;
+		if (head >= tail && used < arena_size)
+		{
+			if (span <= arena_size - head)
+				return true;
+			if (span <= tail)
+			{
+				/* Pad out the end of the arena and go on at the front. */
+				struct zswap_entry *pad = entry_at (head);
+				pad -> t = NULL;
+				pad -> span = arena_size - head;
+				used += pad -> span;
+				head = 0;
+				return true;
+			}
+		}
+		else if (head < tail && span <= tail - head)
+			return true;
+
+		if (!retire_oldest ())
+			return false;
+	}
+}
+
+/* Stores a compressed copy of KPAGE, user page UPAGE of T, which
+   is being evicted, and records it in T's supplemental page
+   table.  Returns false if compressed swap is off, the page does
+   not compress well, or no room can be made; the page must then
+   go to disk. */
+bool
+zswap_store (struct thread *t, void *upage, const void *kpage)
+{
+	struct zswap_entry *e;
+	size_t size, span;
+	bool success = false;
+
+	if (arena_size == 0)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	size = lz_compress (kpage, zbuf, ZSWAP_MAX_SIZE);
+	span = ROUND_UP (sizeof *e + size, ZSWAP_ALIGN);
+	if (size != 0 && make_room (span))
+	{
+		e = entry_at (head);
+		e -> t = t;
+		e -> upage = upage;
+		e -> span = span;
+		e -> size = size;
+		memcpy (e + 1, zbuf, size);
+		/* Under the lock, so that a write back of this record
+		   cannot be overtaken. */
+		page_set_zswapped (t, upage, head);
+		used += span;
+		head += span;
+		if (head == arena_size)
+			head = 0;
+		success = true;
+	}
+	lock_release (&zswap_lock);
+	return success;
+}
+
+/* Decompresses user page UPAGE of T into KPAGE and drops the
+   compressed copy.  Returns false if the copy has been written
+   back to disk since T last looked; T's supplemental page table
+   names its swap slot then. */
+bool
+zswap_load (struct thread *t, void *upage, void *kpage)
+{
+	int handle;
+
+	lock_acquire (&zswap_lock);
+	handle = page_zswap_handle (t, upage);
+	if (handle >= 0)
+	{
+		struct zswap_entry *e = entry_at (handle);
+
+		ASSERT (e -> t == t && e -> upage == upage);
+		lz_decompress ((uint8_t *) (e + 1), e -> size, kpage);
+		e -> t = NULL;
+	}
+	lock_release (&zswap_lock);
+	return handle >= 0;
+}
+
+/* Drops the compressed copy of user page UPAGE of T, if it still
+   has one. */
+void
+zswap_free (struct thread *t, void *upage)
+{
+	int handle;
+
+	lock_acquire (&zswap_lock);
+	handle = page_zswap_handle (t, upage);
+	if (handle >= 0)
+		entry_at (handle) -> t = NULL;
+	lock_release (&zswap_lock);
+}
+
+/* Compressor.  An LZ77 variant: the output is groups of eight
+   items, each group preceded by a byte whose bits, LSB first,
+   tell literals (0) from matches (1).  A literal is one byte.  A
+   match is a 12-bit backward offset and a 4-bit length code, plus
+   one more length byte if the code is 15.  Offsets within a page
+   always fit in 12 bits. */
+
+static unsigned
+lz_hash (const uint8_t *p)
+{
+	uint32_t v = p[0] << 16 | p[1] << 8 | p[2];
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Compresses the page at SRC into DST.  Returns the compressed
+   size, or 0 if it would exceed MAX bytes. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t max)
+{
+	const uint8_t *p = src, *end = src + PGSIZE;
+	uint8_t *q = dst, *q_end = dst + max, *flags = NULL;
+	int bit = 8;
+
+	memset (lz_table, 0, sizeof lz_table);
+	while (p < end)
+	{
+		size_t len = 0, ofs = 0;
+
+		if (bit == 8)
+		{
+			if (q == q_end)
+				return 0;
+			flags = q++;
+			*flags = 0;
+			bit = 0;
+		}
+
+		if (end - p >= LZ_MIN_MATCH)
+		{
+			uint16_t *slot = &lz_table[lz_hash (p)];
+
+			if (*slot != 0)
+			{
+				const uint8_t *cand = src + *slot - 1;
+
+				while (len < LZ_MAX_MATCH && p + len < end && cand[len] == p[len])
+					len++;
+				if (len < LZ_MIN_MATCH)
+					len = 0;
+				ofs = p - cand;
+			}
+			*slot = p - src + 1;
+		}
+
+		if (len != 0)
+		{
+			size_t code = len - LZ_MIN_MATCH;
+
+			if (q_end - q < (code >= 15 ? 3 : 2))
+				return 0;
+			*q++ = ofs >> 4;
+			*q++ = (ofs & 0xf) << 4 | (code < 15 ? code : 15);
+			if (code >= 15)
+				*q++ = code - 15;
+			*flags |= 1 << bit;
+			p += len;
+		}
+		else
+		{
+			if (q == q_end)
+				return 0;
+			*q++ = *p++;
+		}
+		bit++;
+	}
+	return q - dst;
+}
+
+/* Decompresses SIZE bytes at SRC into the page at DST. */
+static void
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+	const uint8_t *p = src, *end = src + size;
+	uint8_t *q = dst;
+	uint8_t flags = 0;
+	int bit = 8;
+
+	while (p < end)
+	{
+		if (bit == 8)
+		{
+			flags = *p++;
+			bit = 0;
+			continue;
+		}
+
+		if (flags & (1 << bit))
+		{
+			size_t ofs = p[0] << 4 | p[1] >> 4;
+			size_t len = (p[1] & 0xf) + LZ_MIN_MATCH;
+
+			p += 2;
+			if (len == LZ_MIN_MATCH + 15)
+				len += *p++;
+			for (; len > 0; len--, q++)
+				*q = *(q - ofs);
+		}
+		else
+			*q++ = *p++;
+		bit++;
+	}
+	ASSERT (q == dst + PGSIZE);
+}
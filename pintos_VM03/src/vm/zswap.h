@@ -0,0 +1,15 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/thread.h"
+
+/* Default and largest size of the compressed swap arena, in
+   pages.  Arena offsets must fit in SECT_BITS. */
+#define ZSWAP_DEFAULT_PAGES 32
+#define ZSWAP_MAX_PAGES 256
+
+extern size_t zswap_pages;
+
+void zswap_init (void);
+bool zswap_store (struct thread *t, void *upage, const void *kpage);
+bool zswap_load (struct thread *t, void *upage, void *kpage);
+void zswap_free (struct thread *t, void *upage);